@@ -0,0 +1,206 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include "number_format.h"
+
+namespace hlp {
+namespace internal {
+constexpr int64_t floorDiv(int64_t value, int64_t divisor) {
+  return value / divisor - (value % divisor < 0);
+}
+
+// Proleptic Gregorian calendar arithmetic on days since 1970-01-01
+// (H. Hinnant's days_from_civil / civil_from_days), exact for any int64
+// day count a Date can hold
+constexpr int64_t daysFromCivil(int64_t year, unsigned month, unsigned day) {
+  year -= month <= 2;
+  int64_t era{ (year >= 0 ? year : year - 399) / 400 };
+  auto yoe{ static_cast<unsigned>(year - era * 400) };
+  unsigned doy{ (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1 };
+  unsigned doe{ yoe * 365 + yoe / 4 - yoe / 100 + doy };
+  return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+struct CivilTime {
+  int64_t year_;
+  unsigned month_;
+  unsigned day_;
+  unsigned hour_;
+  unsigned minute_;
+  unsigned second_;
+  unsigned micro_second_;
+};
+
+// Date part only; the time fields are zero
+constexpr CivilTime civilFromDays(int64_t days) {
+  days += 719468;
+  int64_t era{ (days >= 0 ? days : days - 146096) / 146097 };
+  auto doe{ static_cast<unsigned>(days - era * 146097) };
+  unsigned yoe{ (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365 };
+  unsigned doy{ doe - (365 * yoe + yoe / 4 - yoe / 100) };
+  unsigned mp{ (5 * doy + 2) / 153 };
+  unsigned month{ mp < 10 ? mp + 3 : mp - 9 };
+  return { static_cast<int64_t>(yoe) + era * 400 + (month <= 2),
+           month,
+           doy - (153 * mp + 2) / 5 + 1,
+           0,
+           0,
+           0,
+           0 };
+}
+
+constexpr CivilTime civilFromMicroSeconds(int64_t micro_seconds) {
+  constexpr int64_t kMicrosPerDay{ 86400LL * 1000000 };
+  int64_t days{ micro_seconds / kMicrosPerDay };
+  int64_t rest{ micro_seconds % kMicrosPerDay };
+  if (rest < 0) {
+    rest += kMicrosPerDay;
+    --days;
+  }
+  CivilTime civil{ civilFromDays(days) };
+  auto seconds{ static_cast<unsigned>(rest / 1000000) };
+  civil.hour_ = seconds / 3600;
+  civil.minute_ = seconds / 60 % 60;
+  civil.second_ = seconds % 60;
+  civil.micro_second_ = static_cast<unsigned>(rest % 1000000);
+  return civil;
+}
+
+constexpr bool isLeapYear(int64_t year) {
+  return year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+}
+
+constexpr unsigned daysInMonth(int64_t year, unsigned month) {
+  constexpr unsigned char kDays[]{ 31, 28, 31, 30, 31, 30,
+                                   31, 31, 30, 31, 30, 31 };
+  return month == 2 && isLeapYear(year) ? 29 : kDays[month - 1];
+}
+
+inline void writeTwoDigits(char* buf, unsigned value) {
+  memcpy(buf, kDigitPairs + value * 2, 2);
+}
+
+// Four-digit years as such; others with formatInteger
+inline size_t writeYear(char* buf, int64_t year) {
+  if (year >= 0 && year <= 9999) {
+    writeTwoDigits(buf, static_cast<unsigned>(year / 100));
+    writeTwoDigits(buf + 2, static_cast<unsigned>(year % 100));
+    return 4;
+  }
+  return formatInteger(buf, year);
+}
+
+inline void writeMicroSeconds(char* buf, unsigned micro_second) {
+  writeTwoDigits(buf, micro_second / 10000);
+  writeTwoDigits(buf + 2, micro_second / 100 % 100);
+  writeTwoDigits(buf + 4, micro_second % 100);
+}
+
+// Reads exactly count digits at pos, advancing it
+inline bool readDigits(std::string_view str, size_t& pos, size_t count,
+                       unsigned& value) {
+  if (str.size() - pos < count)
+    return false;
+  unsigned result{ 0 };
+  for (size_t i = 0; i < count; ++i) {
+    auto digit{ static_cast<unsigned>(str[pos + i] - '0') };
+    if (digit > 9)
+      return false;
+    result = result * 10 + digit;
+  }
+  pos += count;
+  value = result;
+  return true;
+}
+
+// "YYYY-MM-DD", optionally followed by ' ' or 'T' and "hh:mm[:ss[.f]]",
+// then optionally "Z" or a "+hh[[:]mm]"/"-hh[[:]mm]" offset; fractions longer
+// than microseconds are truncated. Without an offset the time is taken as
+// UTC and has_offset is false.
+inline bool parseDateTime(std::string_view str, int64_t& micro_seconds,
+                          bool& has_offset) {
+  size_t pos{ 0 };
+  unsigned year, month, day;
+  if (!readDigits(str, pos, 4, year) || pos >= str.size() ||
+      str[pos++] != '-' || !readDigits(str, pos, 2, month) ||
+      pos >= str.size() || str[pos++] != '-' ||
+      !readDigits(str, pos, 2, day)) {
+    return false;
+  }
+  if (month < 1 || month > 12 || day < 1 || day > daysInMonth(year, month))
+    return false;
+
+  unsigned hour{ 0 }, minute{ 0 }, second{ 0 }, micro_second{ 0 };
+  int64_t offset_seconds{ 0 };
+  has_offset = false;
+  if (pos < str.size() && (str[pos] == ' ' || str[pos] == 'T')) {
+    ++pos;
+    if (!readDigits(str, pos, 2, hour) || pos >= str.size() ||
+        str[pos++] != ':' || !readDigits(str, pos, 2, minute)) {
+      return false;
+    }
+    if (pos < str.size() && str[pos] == ':') {
+      ++pos;
+      if (!readDigits(str, pos, 2, second))
+        return false;
+      if (pos < str.size() && str[pos] == '.') {
+        ++pos;
+        size_t digits{ 0 };
+        while (pos < str.size() && str[pos] >= '0' && str[pos] <= '9') {
+          if (digits < 6) {
+            micro_second = micro_second * 10 + (str[pos] - '0');
+          }
+          ++digits;
+          ++pos;
+        }
+        if (digits == 0)
+          return false;
+        for (; digits < 6; ++digits) {
+          micro_second *= 10;
+        }
+      }
+    }
+    if (hour > 23 || minute > 59 || second > 60)
+      return false;
+    if (pos < str.size() && str[pos] == 'Z') {
+      ++pos;
+      has_offset = true;
+    } else if (pos < str.size() && (str[pos] == '+' || str[pos] == '-')) {
+      bool negative{ str[pos++] == '-' };
+      unsigned offset_hour, offset_minute{ 0 };
+      if (!readDigits(str, pos, 2, offset_hour))
+        return false;
+      // Minutes may only be left out without the colon
+      bool colon{ pos < str.size() && str[pos] == ':' };
+      if (colon)
+        ++pos;
+      if ((colon || pos < str.size()) &&
+          !readDigits(str, pos, 2, offset_minute)) {
+        return false;
+      }
+      if (offset_hour > 23 || offset_minute > 59)
+        return false;
+      offset_seconds = (offset_hour * 3600 + offset_minute * 60);
+      if (negative)
+        offset_seconds = -offset_seconds;
+      has_offset = true;
+    }
+  }
+  if (pos != str.size())
+    return false;
+
+  int64_t seconds{ daysFromCivil(year, month, day) * 86400 + hour * 3600 +
+                   minute * 60 + second - offset_seconds };
+  micro_seconds = seconds * 1000000 + micro_second;
+  return true;
+}
+
+inline bool parseDateTime(std::string_view str, int64_t& micro_seconds) {
+  bool has_offset;
+  return parseDateTime(str, micro_seconds, has_offset);
+}
+}  // namespace internal
+}  // namespace hlp
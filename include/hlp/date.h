@@ -2,6 +2,10 @@
 
 #include <cstdint>
 #include <string>
+#include <string_view>
+#include "civil_time.h"
+#include "timezone.h"
+#include "tsc_clock.h"
 
 #define MICRO_SECONDS_PRE_SEC 1000000LL
 
@@ -17,17 +21,37 @@ class Date {
   Date(uint32_t year, uint32_t month, uint32_t day, uint32_t hour = 0,
        uint32_t minute = 0, uint32_t second = 0, uint32_t microSecond = 0);
 
+  enum class ClockSource { SYSTEM, TSC };
+
   static const Date date();
   static Date now() {
+    if (clockSource_() == ClockSource::TSC) {
+      return Date(TscClock::instance().microSecondsSinceEpoch());
+    }
     return date();
   }
 
+  // Clock behind now(); TSC trades a calibration pause at first use for a
+  // few-ns read. Set it before starting logging threads.
+  static void setClockSource(ClockSource source) {
+    clockSource_() = source;
+  }
+  static ClockSource clockSource() {
+    return clockSource_();
+  }
+
   static int64_t timezoneOffset() {
     static int64_t offset = -(
             Date::fromDbStringLocal("1970-01-03 00:00:00").secondsSinceEpoch() -
             2LL * 3600LL * 24LL);
     return offset;
   }
+  // Seconds east of UTC of TimeZone::local() at this date;
+  // Date::now().localOffset() for the current one
+  int64_t localOffset() const {
+    return TimeZone::local().offsetAt(
+            internal::floorDiv(microSecondsSinceEpoch_, MICRO_SECONDS_PRE_SEC));
+  }
   const Date after(double second) const;
   const Date roundSecond() const;
   const Date roundDay() const;
@@ -76,6 +100,70 @@ class Date {
   void toCustomFormattedString(const std::string& fmtStr, char* str,
                                size_t len) const;
 
+  // Fixed-layout parsing and printing by calendar arithmetic: no tm,
+  // strftime, allocation, locale or libc tz lock. The *Local variants use
+  // TimeZone::local(), the others UTC. Printers write at most
+  // kMaxFormattedSize bytes including a terminating NUL and return the
+  // length without it.
+  static constexpr size_t kMaxFormattedSize{ 40 };
+
+  // "YYYY-MM-DD[( |T)hh:mm[:ss[.ffffff]]][Z|(+|-)hh[:mm]]", UTC unless an
+  // offset is given; false leaves date unchanged
+  static bool parseDbString(std::string_view datetime, Date& date) {
+    int64_t micro_seconds;
+    if (!internal::parseDateTime(datetime, micro_seconds))
+      return false;
+    date = Date(micro_seconds);
+    return true;
+  }
+
+  // As parseDbString(), but a time without offset is in TimeZone::local()
+  static bool parseDbStringLocal(std::string_view datetime, Date& date) {
+    int64_t micro_seconds;
+    bool has_offset;
+    if (!internal::parseDateTime(datetime, micro_seconds, has_offset))
+      return false;
+    if (!has_offset) {
+      int64_t seconds{ internal::floorDiv(micro_seconds,
+                                          MICRO_SECONDS_PRE_SEC) };
+      micro_seconds -= TimeZone::local().offsetAtLocal(seconds) *
+                       MICRO_SECONDS_PRE_SEC;
+    }
+    date = Date(micro_seconds);
+    return true;
+  }
+
+  // As toDbString(): "YYYY-MM-DD hh:mm:ss[.uuuuuu]", microseconds only if
+  // non-zero and the date alone at midnight
+  size_t formatDbString(char* buf) const {
+    return formatDbString(buf, microSecondsSinceEpoch_);
+  }
+  size_t formatDbStringLocal(char* buf) const {
+    return formatDbString(
+            buf, TimeZone::local().toLocalMicroSeconds(microSecondsSinceEpoch_));
+  }
+
+  // "YYYY-MM-DDThh:mm:ss[.uuuuuu]Z"
+  size_t formatIso8601(char* buf, bool is_show_us = true) const {
+    auto t{ internal::civilFromMicroSeconds(microSecondsSinceEpoch_) };
+    size_t len{ formatCivilDate(buf, t, '-') };
+    buf[len++] = 'T';
+    len += formatCivilTime(buf + len, t, is_show_us);
+    buf[len++] = 'Z';
+    buf[len] = '\0';
+    return len;
+  }
+
+  // As toFormattedString(): "YYYYMMDD hh:mm:ss[.uuuuuu]"
+  size_t formatTimestamp(char* buf, bool is_show_us) const {
+    return formatTimestamp(buf, microSecondsSinceEpoch_, is_show_us);
+  }
+  size_t formatTimestampLocal(char* buf, bool is_show_us) const {
+    return formatTimestamp(
+            buf, TimeZone::local().toLocalMicroSeconds(microSecondsSinceEpoch_),
+            is_show_us);
+  }
+
   bool isSameSecond(const Date& date) const {
     return microSecondsSinceEpoch_ / MICRO_SECONDS_PRE_SEC ==
            date.secondsSinceEpoch();
@@ -86,6 +174,60 @@ class Date {
   }
 
  private:
+  static size_t formatDbString(char* buf, int64_t micro_seconds) {
+    auto t{ internal::civilFromMicroSeconds(micro_seconds) };
+    size_t len{ formatCivilDate(buf, t, '-') };
+    if (t.hour_ != 0 || t.minute_ != 0 || t.second_ != 0 ||
+        t.micro_second_ != 0) {
+      buf[len++] = ' ';
+      len += formatCivilTime(buf + len, t, t.micro_second_ != 0);
+    }
+    buf[len] = '\0';
+    return len;
+  }
+
+  static size_t formatTimestamp(char* buf, int64_t micro_seconds,
+                                bool is_show_us) {
+    auto t{ internal::civilFromMicroSeconds(micro_seconds) };
+    size_t len{ formatCivilDate(buf, t, '\0') };
+    buf[len++] = ' ';
+    len += formatCivilTime(buf + len, t, is_show_us);
+    buf[len] = '\0';
+    return len;
+  }
+
+  static size_t formatCivilDate(char* buf, const internal::CivilTime& t,
+                                char separator) {
+    size_t len{ internal::writeYear(buf, t.year_) };
+    if (separator)
+      buf[len++] = separator;
+    internal::writeTwoDigits(buf + len, t.month_);
+    len += 2;
+    if (separator)
+      buf[len++] = separator;
+    internal::writeTwoDigits(buf + len, t.day_);
+    return len + 2;
+  }
+
+  static size_t formatCivilTime(char* buf, const internal::CivilTime& t,
+                                bool is_show_us) {
+    internal::writeTwoDigits(buf, t.hour_);
+    buf[2] = ':';
+    internal::writeTwoDigits(buf + 3, t.minute_);
+    buf[5] = ':';
+    internal::writeTwoDigits(buf + 6, t.second_);
+    if (!is_show_us)
+      return 8;
+    buf[8] = '.';
+    internal::writeMicroSeconds(buf + 9, t.micro_second_);
+    return 15;
+  }
+
+  static ClockSource& clockSource_() {
+    static ClockSource source{ ClockSource::SYSTEM };
+    return source;
+  }
+
   int64_t microSecondsSinceEpoch_{};
 };
 }  // namespace hlp
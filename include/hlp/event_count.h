@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "non_copyable.h"
+
+#if defined(__linux__)
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+namespace hlp {
+
+// Lets a thread park until some lock-free condition may have changed,
+// without the notifier taking a lock when nobody waits. Usage:
+//   auto key{ ec.prepareWait() };
+//   if (condition()) ec.cancelWait(); else ec.wait(key);
+// The notifier makes the condition true and then calls notify().
+class EventCount : public NonCopyable {
+ public:
+  using Key = uint32_t;
+
+  Key prepareWait() {
+    waiters_.fetch_add(1, std::memory_order_seq_cst);
+    return epoch_.load(std::memory_order_acquire);
+  }
+
+  void cancelWait() {
+    waiters_.fetch_sub(1, std::memory_order_seq_cst);
+  }
+
+  void wait(Key key) {
+    while (epoch_.load(std::memory_order_acquire) == key) {
+      park(key, -1);
+    }
+    waiters_.fetch_sub(1, std::memory_order_seq_cst);
+  }
+
+  // Returns false if the timeout expired before a notification
+  template <typename Rep, typename Period>
+  bool waitFor(Key key, const std::chrono::duration<Rep, Period>& timeout) {
+    auto deadline{ std::chrono::steady_clock::now() + timeout };
+    bool notified{ true };
+    while (epoch_.load(std::memory_order_acquire) == key) {
+      auto left{ std::chrono::duration_cast<std::chrono::nanoseconds>(
+              deadline - std::chrono::steady_clock::now()) };
+      if (left.count() <= 0) {
+        notified = false;
+        break;
+      }
+      park(key, left.count());
+    }
+    waiters_.fetch_sub(1, std::memory_order_seq_cst);
+    return notified;
+  }
+
+  void notify() {
+    wake(false);
+  }
+
+  void notifyAll() {
+    wake(true);
+  }
+
+ private:
+  void wake(bool all) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters_.load(std::memory_order_relaxed) == 0) {
+      return;
+    }
+#if defined(__linux__)
+    epoch_.fetch_add(1, std::memory_order_release);
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_),
+            FUTEX_WAKE_PRIVATE, all ? INT_MAX : 1, nullptr, nullptr, 0);
+#else
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      epoch_.fetch_add(1, std::memory_order_release);
+    }
+    if (all) {
+      cond_.notify_all();
+    } else {
+      cond_.notify_one();
+    }
+#endif
+  }
+
+  void park(Key key, int64_t timeout_ns) {
+#if defined(__linux__)
+    timespec ts{};
+    timespec* ts_ptr{ nullptr };
+    if (timeout_ns >= 0) {
+      ts.tv_sec = static_cast<time_t>(timeout_ns / 1000000000);
+      ts.tv_nsec = static_cast<long>(timeout_ns % 1000000000);
+      ts_ptr = &ts;
+    }
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_),
+            FUTEX_WAIT_PRIVATE, key, ts_ptr, nullptr, 0);
+#else
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (epoch_.load(std::memory_order_relaxed) != key) {
+      return;
+    }
+    if (timeout_ns >= 0) {
+      cond_.wait_for(lock, std::chrono::nanoseconds(timeout_ns));
+    } else {
+      cond_.wait(lock);
+    }
+#endif
+  }
+
+  static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+                "futex word must be a plain 32-bit integer");
+  std::atomic<uint32_t> epoch_{ 0 };
+  std::atomic<uint32_t> waiters_{ 0 };
+#if !defined(__linux__)
+  std::mutex mutex_;
+  std::condition_variable cond_;
+#endif
+};
+}  // namespace hlp
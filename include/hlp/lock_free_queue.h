@@ -1,7 +1,16 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
 #include <utility>
+#include "event_count.h"
 #include "non_copyable.h"
 
 namespace hlp {
@@ -15,41 +24,93 @@ class MpscQueue : public NonCopyable {
             tail_{ head_.load(std::memory_order_relaxed) } {
   }
   ~MpscQueue() {
-    T output{};
-    while (dequeue(output)) {
-    }
+    drain([](T&&) {});
 
     BufferNode* front{ head_.load(std::memory_order_relaxed) };
     delete front;
   }
 
   void enqueue(const T& input) {
-    BufferNode* node{ new BufferNode{ input } };
-    BufferNode* old_head{ head_.exchange(node, std::memory_order_acq_rel) };
-    old_head->next_.store(node, std::memory_order_release);
+    push(new BufferNode{ input });
   }
 
   void enqueue(T&& input) {
-    BufferNode* node{ new BufferNode({ std::move(input) }) };
-    BufferNode* old_head{ head_.exchange(node, std::memory_order_acq_rel) };
-    old_head->next_.store(node, std::memory_order_release);
+    push(new BufferNode{ std::move(input) });
   }
 
   bool dequeue(T& output) {
-    BufferNode* tail{ tail_.load(std::memory_order_relaxed) };
-    BufferNode* next{ tail->next_.load(std::memory_order_acquire) };
+    return drain([&output](T&& data) { output = std::move(data); }, 1) != 0;
+  }
+
+  // Moves up to max elements to out; returns how many were taken
+  template <typename OutputIt>
+  size_t dequeueBulk(OutputIt out, size_t max) {
+    return drain([&out](T&& data) { *out++ = std::move(data); }, max);
+  }
+
+  // Hands every available element (up to max) to fn in FIFO order. The
+  // whole run is unlinked with a single tail_ store and its nodes are freed
+  // afterwards in one pass.
+  template <typename Fn>
+  size_t drain(Fn&& fn, size_t max = std::numeric_limits<size_t>::max()) {
+    BufferNode* first{ tail_.load(std::memory_order_relaxed) };
+    BufferNode* last{ first };
+    BufferNode* next{ last->next_.load(std::memory_order_acquire) };
+    size_t count{ 0 };
 
-    if (!next)
-      return false;
+    while (next && count < max) {
+      T* data{ next->data() };
+      fn(std::move(*data));
+      data->~T();
+      last = next;
+      next = last->next_.load(std::memory_order_acquire);
+      ++count;
+    }
+    if (count == 0)
+      return 0;
 
-    output = std::move(*next->data_ptr_);
-    delete next->data_ptr_;
-    tail_.store(next, std::memory_order_release);
-    delete tail;
+    tail_.store(last, std::memory_order_release);
+    while (first != last) {
+      BufferNode* node{ first->next_.load(std::memory_order_relaxed) };
+      delete first;
+      first = node;
+    }
+    return count;
+  }
 
+  // Parks the consumer (futex on Linux) until an element is available
+  bool waitDequeue(T& output) {
+    while (!dequeue(output)) {
+      auto key{ not_empty_.prepareWait() };
+      if (!empty()) {
+        not_empty_.cancelWait();
+        continue;
+      }
+      not_empty_.wait(key);
+    }
     return true;
   }
 
+  template <typename Rep, typename Period>
+  bool waitDequeueFor(T& output,
+                      const std::chrono::duration<Rep, Period>& timeout) {
+    return waitNotEmptyFor(timeout) && dequeue(output);
+  }
+
+  // Returns false if the queue is still empty when the timeout expires
+  template <typename Rep, typename Period>
+  bool waitNotEmptyFor(const std::chrono::duration<Rep, Period>& timeout) {
+    if (!empty())
+      return true;
+    auto key{ not_empty_.prepareWait() };
+    if (!empty()) {
+      not_empty_.cancelWait();
+      return true;
+    }
+    not_empty_.waitFor(key, timeout);
+    return !empty();
+  }
+
   bool empty() const {
     BufferNode* tail{ tail_.load(std::memory_order_relaxed) };
     BufferNode* next{ tail->next_.load(std::memory_order_acquire) };
@@ -61,15 +122,282 @@ class MpscQueue : public NonCopyable {
   class BufferNode {
    public:
     BufferNode() = default;
-    explicit BufferNode(const T& data) : data_ptr_(new T(data)) {
+    explicit BufferNode(const T& data) {
+      new (&storage_) T(data);
+    }
+    explicit BufferNode(T&& data) {
+      new (&storage_) T(std::move(data));
     }
-    explicit BufferNode(T&& data) : data_ptr_(new T(std::move(data))) {
+
+    T* data() {
+      return std::launder(reinterpret_cast<T*>(&storage_));
     }
 
-    T* data_ptr_{ nullptr };
+    std::aligned_storage_t<sizeof(T), alignof(T)> storage_;
     std::atomic<BufferNode*> next_{ nullptr };
   };
+
+  void push(BufferNode* node) {
+    BufferNode* old_head{ head_.exchange(node, std::memory_order_acq_rel) };
+    old_head->next_.store(node, std::memory_order_release);
+    not_empty_.notify();
+  }
+
   std::atomic<BufferNode*> head_{ nullptr };
   std::atomic<BufferNode*> tail_{ nullptr };
+  EventCount not_empty_;
+};
+
+inline constexpr size_t kCacheLineSize{ 64 };
+
+namespace internal {
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#else
+  std::this_thread::yield();
+#endif
+}
+
+inline size_t roundUpPowerOfTwo(size_t value) {
+  size_t result{ 2 };
+  while (result < value) {
+    result <<= 1;
+  }
+  return result;
+}
+}  // namespace internal
+
+// What a producer of a BoundedMpscQueue does when the ring is full
+enum class QueueFullPolicy {
+  BLOCK,        // park the producer until the consumer frees a slot
+  SPIN,         // busy-wait (yielding now and then) until a slot frees up
+  DROP_NEWEST,  // discard the element being enqueued
+  DROP_OLDEST   // evict the oldest queued element to make room
+};
+
+// Multi producer single consumer queue on a preallocated ring of
+// cache-line-padded slots (Vyukov's per-slot sequence scheme). Nothing is
+// allocated after construction, so enqueue/dequeue never touch malloc.
+template <typename T, QueueFullPolicy Policy = QueueFullPolicy::BLOCK>
+class BoundedMpscQueue : public NonCopyable {
+ public:
+  explicit BoundedMpscQueue(size_t capacity)
+          : mask_{ internal::roundUpPowerOfTwo(capacity) - 1 },
+            slots_{ new Slot[mask_ + 1] } {
+    for (size_t i = 0; i <= mask_; ++i) {
+      slots_[i].seq_.store(i, std::memory_order_relaxed);
+    }
+  }
+  ~BoundedMpscQueue() {
+    while (pop([](T&) {})) {
+    }
+  }
+
+  bool enqueue(const T& input) {
+    return emplace(input);
+  }
+
+  bool enqueue(T&& input) {
+    return emplace(std::move(input));
+  }
+
+  // Returns false only when the element was discarded (DROP_NEWEST)
+  template <typename... Args>
+  bool emplace(Args&&... args) {
+    size_t spins{ 0 };
+    while (!tryEmplace(std::forward<Args>(args)...)) {
+      if constexpr (Policy == QueueFullPolicy::DROP_NEWEST) {
+        dropped_counter_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      } else if constexpr (Policy == QueueFullPolicy::DROP_OLDEST) {
+        if (pop([](T&) {})) {
+          dropped_counter_.fetch_add(1, std::memory_order_relaxed);
+        }
+      } else if constexpr (Policy == QueueFullPolicy::SPIN) {
+        if (++spins < kSpinsBeforeBlock) {
+          internal::cpuRelax();
+        } else {
+          std::this_thread::yield();
+          spins = 0;
+        }
+      } else {
+        if (++spins < kSpinsBeforeBlock) {
+          internal::cpuRelax();
+        } else {
+          waitNotFull();
+          spins = 0;
+        }
+      }
+    }
+    return true;
+  }
+
+  bool dequeue(T& output) {
+    return drain([&output](T&& data) { output = std::move(data); }, 1) != 0;
+  }
+
+  template <typename OutputIt>
+  size_t dequeueBulk(OutputIt out, size_t max) {
+    return drain([&out](T&& data) { *out++ = std::move(data); }, max);
+  }
+
+  // Hands up to max queued elements to fn; blocked producers are woken once
+  // per run rather than once per element.
+  template <typename Fn>
+  size_t drain(Fn&& fn, size_t max = std::numeric_limits<size_t>::max()) {
+    size_t count{ 0 };
+    while (count < max && pop([&fn](T& data) { fn(std::move(data)); })) {
+      ++count;
+    }
+    if constexpr (Policy == QueueFullPolicy::BLOCK) {
+      if (count)
+        not_full_.notifyAll();
+    }
+    return count;
+  }
+
+  bool waitDequeue(T& output) {
+    while (!dequeue(output)) {
+      auto key{ not_empty_.prepareWait() };
+      if (!empty()) {
+        not_empty_.cancelWait();
+        continue;
+      }
+      not_empty_.wait(key);
+    }
+    return true;
+  }
+
+  template <typename Rep, typename Period>
+  bool waitDequeueFor(T& output,
+                      const std::chrono::duration<Rep, Period>& timeout) {
+    return waitNotEmptyFor(timeout) && dequeue(output);
+  }
+
+  template <typename Rep, typename Period>
+  bool waitNotEmptyFor(const std::chrono::duration<Rep, Period>& timeout) {
+    if (!empty())
+      return true;
+    auto key{ not_empty_.prepareWait() };
+    if (!empty()) {
+      not_empty_.cancelWait();
+      return true;
+    }
+    not_empty_.waitFor(key, timeout);
+    return !empty();
+  }
+
+  bool empty() const {
+    size_t pos{ dequeue_pos_.load(std::memory_order_relaxed) };
+    const Slot& slot{ slots_[pos & mask_] };
+    return slot.seq_.load(std::memory_order_acquire) != pos + 1;
+  }
+
+  size_t size() const {
+    size_t tail{ dequeue_pos_.load(std::memory_order_relaxed) };
+    size_t head{ enqueue_pos_.load(std::memory_order_relaxed) };
+    return head > tail ? head - tail : 0;
+  }
+
+  size_t capacity() const {
+    return mask_ + 1;
+  }
+
+  uint64_t droppedCount() const {
+    return dropped_counter_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  static constexpr size_t kSpinsBeforeBlock{ 128 };
+
+  struct alignas(kCacheLineSize) Slot {
+    T* data() {
+      return std::launder(reinterpret_cast<T*>(&storage_));
+    }
+
+    std::atomic<size_t> seq_{ 0 };
+    std::aligned_storage_t<sizeof(T), alignof(T)> storage_;
+  };
+
+  template <typename... Args>
+  bool tryEmplace(Args&&... args) {
+    size_t pos{ enqueue_pos_.load(std::memory_order_relaxed) };
+    for (;;) {
+      Slot& slot{ slots_[pos & mask_] };
+      size_t seq{ slot.seq_.load(std::memory_order_acquire) };
+      auto diff{ static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos) };
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          new (&slot.storage_) T(std::forward<Args>(args)...);
+          slot.seq_.store(pos + 1, std::memory_order_release);
+          not_empty_.notify();
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // DROP_OLDEST producers evict from the consumer side, so only that policy
+  // pays for a CAS on dequeue_pos_; otherwise the single consumer owns it.
+  template <typename Fn>
+  bool pop(Fn&& fn) {
+    size_t pos{ dequeue_pos_.load(std::memory_order_relaxed) };
+    for (;;) {
+      Slot& slot{ slots_[pos & mask_] };
+      size_t seq{ slot.seq_.load(std::memory_order_acquire) };
+      auto diff{ static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1) };
+      if (diff < 0) {
+        return false;
+      }
+      if (diff > 0) {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+        continue;
+      }
+      if constexpr (Policy == QueueFullPolicy::DROP_OLDEST) {
+        if (!dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+                                                std::memory_order_relaxed)) {
+          continue;
+        }
+      } else {
+        dequeue_pos_.store(pos + 1, std::memory_order_relaxed);
+      }
+      T* data{ slot.data() };
+      fn(*data);
+      data->~T();
+      slot.seq_.store(pos + mask_ + 1, std::memory_order_release);
+      return true;
+    }
+  }
+
+  bool full() const {
+    size_t pos{ enqueue_pos_.load(std::memory_order_relaxed) };
+    const Slot& slot{ slots_[pos & mask_] };
+    return slot.seq_.load(std::memory_order_acquire) != pos;
+  }
+
+  void waitNotFull() {
+    auto key{ not_full_.prepareWait() };
+    if (!full()) {
+      not_full_.cancelWait();
+      return;
+    }
+    not_full_.wait(key);
+  }
+
+  const size_t mask_;
+  std::unique_ptr<Slot[]> slots_;
+  alignas(kCacheLineSize) std::atomic<size_t> enqueue_pos_{ 0 };
+  alignas(kCacheLineSize) std::atomic<size_t> dequeue_pos_{ 0 };
+  alignas(kCacheLineSize) std::atomic<uint64_t> dropped_counter_{ 0 };
+  EventCount not_empty_;
+  EventCount not_full_;
 };
 }  // namespace hlp
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+namespace hlp {
+namespace internal {
+inline constexpr char kDigitPairs[201] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+inline constexpr char kHexDigits[] = "0123456789ABCDEF";
+
+inline constexpr uint64_t kPowersOf10[20]{ 1ULL,
+                                           10ULL,
+                                           100ULL,
+                                           1000ULL,
+                                           10000ULL,
+                                           100000ULL,
+                                           1000000ULL,
+                                           10000000ULL,
+                                           100000000ULL,
+                                           1000000000ULL,
+                                           10000000000ULL,
+                                           100000000000ULL,
+                                           1000000000000ULL,
+                                           10000000000000ULL,
+                                           100000000000000ULL,
+                                           1000000000000000ULL,
+                                           10000000000000000ULL,
+                                           100000000000000000ULL,
+                                           1000000000000000000ULL,
+                                           10000000000000000000ULL };
+
+inline int bitWidth(uint64_t value) {
+  return 64 - __builtin_clzll(value | 1);
+}
+
+// Number of decimal digits of value (1 for 0): log10 estimated from the bit
+// width (1233 / 4096 ~ log10(2)) and corrected with one comparison
+inline int countDigits(uint64_t value) {
+  int t{ (bitWidth(value) * 1233) >> 12 };
+  return t + 1 - static_cast<int>((value | 1) < kPowersOf10[t]);
+}
+
+inline int countHexDigits(uint64_t value) {
+  return (bitWidth(value) + 3) / 4;
+}
+
+// Writes value backwards ending at end, two digits per step
+inline void writeDigits(char* end, uint64_t value) {
+  while (value >= 100) {
+    end -= 2;
+    memcpy(end, kDigitPairs + (value % 100) * 2, 2);
+    value /= 100;
+  }
+  if (value >= 10) {
+    memcpy(end - 2, kDigitPairs + value * 2, 2);
+  } else {
+    end[-1] = static_cast<char>('0' + value);
+  }
+}
+
+// Decimal text of value without a terminator; returns the length
+template <typename T>
+size_t formatInteger(char* buf, T value) {
+  static_assert(std::is_integral_v<T>, "integer expected");
+  using U = std::make_unsigned_t<T>;
+  auto magnitude{ static_cast<uint64_t>(static_cast<U>(value)) };
+  size_t sign{ 0 };
+  if constexpr (std::is_signed_v<T>) {
+    if (value < 0) {
+      *buf = '-';
+      sign = 1;
+      magnitude = uint64_t{ 0 } -
+                  static_cast<uint64_t>(static_cast<int64_t>(value));
+    }
+  }
+  auto len{ static_cast<size_t>(countDigits(magnitude)) };
+  writeDigits(buf + sign + len, magnitude);
+  return sign + len;
+}
+
+// Upper-case hex text of value without a terminator; returns the length
+inline size_t formatHex(char* buf, uint64_t value) {
+  auto len{ static_cast<size_t>(countHexDigits(value)) };
+#if defined(__SSSE3__)
+  // Spread the nibbles of the big-endian value over 16 bytes and map them
+  // to characters with one shuffle
+  const __m128i mask{ _mm_set1_epi8(0x0f) };
+  __m128i bytes{ _mm_cvtsi64_si128(
+          static_cast<long long>(__builtin_bswap64(value))) };
+  __m128i hi{ _mm_and_si128(_mm_srli_epi64(bytes, 4), mask) };
+  __m128i lo{ _mm_and_si128(bytes, mask) };
+  __m128i lut{ _mm_loadu_si128(reinterpret_cast<const __m128i*>(kHexDigits)) };
+  __m128i chars{ _mm_shuffle_epi8(lut, _mm_unpacklo_epi8(hi, lo)) };
+  char tmp[16];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(tmp), chars);
+  memcpy(buf, tmp + 16 - len, len);
+#else
+  char* p{ buf + len };
+  do {
+    *--p = kHexDigits[value & 0xf];
+    value >>= 4;
+  } while (value);
+#endif
+  return len;
+}
+
+// Buffer size that fits any formatDouble()/formatFixed() output
+inline constexpr size_t kMaxFloatSize{ 40 };
+
+inline size_t formatNonFinite(char* buf, double value) {
+  if (std::isnan(value)) {
+    memcpy(buf, "nan", 3);
+    return 3;
+  }
+  if (value < 0) {
+    memcpy(buf, "-inf", 4);
+    return 4;
+  }
+  memcpy(buf, "inf", 3);
+  return 3;
+}
+
+// Shortest text that parses back to the same value: plain notation for
+// decimal exponents in [-5, 17), scientific otherwise. Uses the C++17
+// std::to_chars (Ryu in libstdc++), so there is no locale or heap involved.
+template <typename T>
+size_t formatFloat(char* buf, T value) {
+  static_assert(std::is_same_v<T, float> || std::is_same_v<T, double>,
+                "float or double expected");
+  if (!std::isfinite(value))
+    return formatNonFinite(buf, value);
+#if defined(__cpp_lib_to_chars)
+  char sci[kMaxFloatSize];
+  auto end{ std::to_chars(sci, sci + sizeof(sci), value,
+                          std::chars_format::scientific)
+                    .ptr };
+  const char* p{ sci };
+  char* out{ buf };
+  if (*p == '-') {
+    *out++ = *p++;
+  }
+  const char* mantissa{ p };
+  char digits[20];
+  int count{ 0 };
+  for (; *p != 'e'; ++p) {
+    if (*p != '.')
+      digits[count++] = *p;
+  }
+  int exp{ 0 };
+  for (const char* q = p + 2; q < end; ++q)
+    exp = exp * 10 + (*q - '0');
+  if (p[1] == '-')
+    exp = -exp;
+
+  if (exp < -5 || exp >= 17) {
+    size_t len{ static_cast<size_t>(end - mantissa) };
+    memcpy(out, mantissa, len);
+    out += len;
+  } else if (exp < 0) {
+    *out++ = '0';
+    *out++ = '.';
+    for (int i = -1; i > exp; --i)
+      *out++ = '0';
+    memcpy(out, digits, count);
+    out += count;
+  } else if (count <= exp + 1) {
+    memcpy(out, digits, count);
+    out += count;
+    for (int i = count; i <= exp; ++i)
+      *out++ = '0';
+  } else {
+    memcpy(out, digits, exp + 1);
+    out += exp + 1;
+    *out++ = '.';
+    memcpy(out, digits + exp + 1, count - exp - 1);
+    out += count - exp - 1;
+  }
+  return static_cast<size_t>(out - buf);
+#else
+  int len{ 0 };
+  for (int precision = std::is_same_v<T, float> ? 6 : 15; precision <= 17;
+       ++precision) {
+    len = snprintf(buf, kMaxFloatSize, "%.*g", precision,
+                   static_cast<double>(value));
+    if (static_cast<T>(strtod(buf, nullptr)) == value)
+      break;
+  }
+  return static_cast<size_t>(len);
+#endif
+}
+
+inline size_t formatDouble(char* buf, double value) {
+  return formatFloat(buf, value);
+}
+
+// Exactly precision (at most 17) decimals; magnitudes of 1e17 and above fall
+// back to formatDouble()
+inline size_t formatFixed(char* buf, double value, int precision) {
+  if (!std::isfinite(value) || std::fabs(value) >= 1e17)
+    return formatDouble(buf, value);
+  precision = precision < 0 ? 0 : (precision > 17 ? 17 : precision);
+#if defined(__cpp_lib_to_chars)
+  return static_cast<size_t>(std::to_chars(buf, buf + kMaxFloatSize, value,
+                                           std::chars_format::fixed,
+                                           precision)
+                                     .ptr -
+                             buf);
+#else
+  return static_cast<size_t>(
+          snprintf(buf, kMaxFloatSize, "%.*f", precision, value));
+#endif
+}
+}  // namespace internal
+
+// Streams a floating-point value with a fixed number of decimals:
+//   LOG_INFO << "px " << hlp::fixed(px, 2);
+struct FixedFloat {
+  double value_;
+  int precision_;
+};
+
+inline FixedFloat fixed(double value, int precision) {
+  return { value, precision };
+}
+}  // namespace hlp
@@ -1,104 +1,210 @@
 #pragma once
 
-#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
 #include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
 #include <utility>
+#include "date.h"
+#include "non_copyable.h"
+#include "number_format.h"
 
 namespace hlp {
-namespace internal {
-template <typename T, typename = void>
-struct CanConvertToString : std::false_type {};
 
-template <typename T>
-struct CanConvertToString<
-        T, std::void_t<decltype(std::to_string(std::declval<T>()))>>
-        : std::true_type {};
-}  // namespace internal
-
-class OSStream {
+// String builder that formats into an inline buffer and, once that is full,
+// into memory from a std::pmr::memory_resource: the default resource, or a
+// caller-supplied arena such as std::pmr::monotonic_buffer_resource so that
+// building a string never reaches the global heap. Integers, floats,
+// strings, pointers and Date are formatted directly; other types fall back
+// to their std::ostream operator<<.
+class OSStream : public NonCopyable {
  public:
+  static constexpr size_t kInlineSize{ 256 };
+
   OSStream() = default;
 
-  void reserve(size_t size) {
-    buffer_.reserve(size);
+  explicit OSStream(std::pmr::memory_resource* resource)
+          : resource_(resource) {
   }
 
-  template <typename T>
-  OSStream& operator<<(T&& value) {
-    if constexpr (internal::CanConvertToString<T>::value) {
-      buffer_.append(std::to_string(std::forward<T>(value)));
-      return *this;
-    } else {
-      std::stringstream ss;
-      ss << std::forward<T>(value);
-      buffer_.append(ss.str());
-      return *this;
-    }
+  OSStream(OSStream&& that) noexcept : resource_(that.resource_) {
+    moveFrom(that);
   }
 
-  template <int N>
-  OSStream& operator<<(const char (&buf)[N]) {
-    buffer_.append(buf, N - 1);
+  OSStream& operator=(OSStream&& that) noexcept {
+    if (this != &that) {
+      release();
+      resource_ = that.resource_;
+      moveFrom(that);
+    }
     return *this;
   }
 
-  OSStream& operator<<(const std::string_view& str) {
-    buffer_.append(str.data(), str.length());
+  ~OSStream() {
+    release();
+  }
+
+  void reserve(size_t size) {
+    if (size > capacity_)
+      grow(size);
+  }
+
+  void append(const char* data, size_t len) {
+    memcpy(room(len), data, len);
+    size_ += len;
+  }
+
+  void clear() {
+    size_ = 0;
+  }
+
+  const char* data() const {
+    return data_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  std::string_view view() const {
+    return { data_, size_ };
+  }
+
+  std::string str() const {
+    return std::string(data_, size_);
+  }
+
+  OSStream& operator<<(bool v) {
+    return operator<<(v ? '1' : '0');
+  }
+
+  OSStream& operator<<(char v) {
+    *room(1) = v;
+    ++size_;
     return *this;
   }
 
-  OSStream& operator<<(std::string_view&& str) {
-    buffer_.append(str.data(), str.length());
+  OSStream& operator<<(std::string_view str) {
+    append(str.data(), str.size());
     return *this;
   }
 
   OSStream& operator<<(const std::string& str) {
-    buffer_.append(str);
+    append(str.data(), str.size());
     return *this;
   }
 
-  OSStream& operator<<(std::string&& str) {
-    buffer_.append(std::move(str));
+  OSStream& operator<<(const char* str) {
+    if (str) {
+      append(str, strlen(str));
+    } else {
+      append("(null)", 6);
+    }
     return *this;
   }
 
-  OSStream& operator<<(const double& d) {
-    std::stringstream ss;
-    ss << d;
-    buffer_.append(ss.str());
+  OSStream& operator<<(char* str) {
+    return operator<<(static_cast<const char*>(str));
+  }
+
+  OSStream& operator<<(double v) {
+    size_ += internal::formatDouble(room(internal::kMaxFloatSize), v);
     return *this;
   }
 
-  OSStream& operator<<(const float& f) {
-    std::stringstream ss;
-    ss << f;
-    buffer_.append(ss.str());
+  OSStream& operator<<(float v) {
+    size_ += internal::formatFloat(room(internal::kMaxFloatSize), v);
     return *this;
   }
 
-  OSStream& operator<<(double&& d) {
-    std::stringstream ss;
-    ss << d;
-    buffer_.append(ss.str());
+  OSStream& operator<<(long double v) {
+    return operator<<(static_cast<double>(v));
+  }
+
+  OSStream& operator<<(FixedFloat v) {
+    size_ += internal::formatFixed(room(internal::kMaxFloatSize), v.value_,
+                                   v.precision_);
     return *this;
   }
 
-  OSStream& operator<<(float&& f) {
-    std::stringstream ss;
-    ss << f;
-    buffer_.append(ss.str());
+  OSStream& operator<<(const void* p) {
+    char* buf{ room(2 + 2 * sizeof(uintptr_t)) };
+    buf[0] = '0';
+    buf[1] = 'x';
+    size_ += 2 + internal::formatHex(buf + 2, reinterpret_cast<uintptr_t>(p));
     return *this;
   }
 
-  std::string& str() {
-    return buffer_;
+  // UTC "yyyymmdd hh:mm:ss.uuuuuu", as Date::toFormattedString(true)
+  OSStream& operator<<(const Date& date) {
+    size_ += date.formatTimestamp(room(Date::kMaxFormattedSize), true);
+    return *this;
   }
 
-  const std::string& str() const {
-    return buffer_;
+  template <typename T>
+  OSStream& operator<<(const T& value) {
+    if constexpr (std::is_integral_v<T>) {
+      size_ += internal::formatInteger(room(24), value);
+    } else if constexpr (std::is_pointer_v<T>) {
+      operator<<(static_cast<const void*>(value));
+    } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+      operator<<(std::string_view(value));
+    } else {
+      std::ostringstream ss;
+      ss << value;
+      operator<<(ss.str());
+    }
+    return *this;
   }
 
  private:
-  std::string buffer_;
+  // Space for n more bytes at data_ + size_
+  char* room(size_t n) {
+    if (capacity_ - size_ < n)
+      grow(size_ + n);
+    return data_ + size_;
+  }
+
+  void grow(size_t need) {
+    size_t capacity{ capacity_ * 2 };
+    if (capacity < need)
+      capacity = need;
+    auto data{ static_cast<char*>(resource_->allocate(capacity, 1)) };
+    memcpy(data, data_, size_);
+    release();
+    data_ = data;
+    capacity_ = capacity;
+  }
+
+  void release() {
+    if (data_ != inline_) {
+      resource_->deallocate(data_, capacity_, 1);
+      data_ = inline_;
+      capacity_ = kInlineSize;
+    }
+  }
+
+  void moveFrom(OSStream& that) {
+    if (that.data_ == that.inline_) {
+      memcpy(inline_, that.inline_, that.size_);
+    } else {
+      data_ = that.data_;
+      capacity_ = that.capacity_;
+      that.data_ = that.inline_;
+      that.capacity_ = kInlineSize;
+    }
+    size_ = that.size_;
+    that.size_ = 0;
+  }
+
+  std::pmr::memory_resource* resource_{ std::pmr::get_default_resource() };
+  char* data_{ inline_ };
+  size_t size_{ 0 };
+  size_t capacity_{ kInlineSize };
+  char inline_[kInlineSize];
 };
 }  // namespace hlp
@@ -0,0 +1,437 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "civil_time.h"
+#include "non_copyable.h"
+
+namespace hlp {
+
+namespace internal {
+// POSIX TZ rule such as "CET-1CEST,M3.5.0,M10.5.0/3", as given in $TZ or
+// in the footer of a TZif file
+struct TzRule {
+  // Jn (1-based, Feb 29 never counted), n (0-based) or Mm.w.d
+  enum class ChangeKind { JULIAN, ZERO_BASED, MONTH_WEEK_DAY };
+
+  struct Change {
+    ChangeKind kind_{ ChangeKind::MONTH_WEEK_DAY };
+    int month_{ 0 };
+    int week_{ 0 };
+    int day_{ 0 };
+    // Local wall-clock seconds after midnight
+    int32_t time_{ 7200 };
+  };
+
+  // Seconds east of UTC
+  int32_t std_offset_{ 0 };
+  int32_t dst_offset_{ 0 };
+  bool has_dst_{ false };
+  Change start_;
+  Change end_;
+
+  // UTC second of change in year, offset being the one in force before it
+  static int64_t changeTime(int64_t year, const Change& change,
+                            int32_t offset) {
+    int64_t day;
+    if (change.kind_ == ChangeKind::JULIAN) {
+      day = daysFromCivil(year, 1, 1) + change.day_ - 1 +
+            (isLeapYear(year) && change.day_ >= 60);
+    } else if (change.kind_ == ChangeKind::ZERO_BASED) {
+      day = daysFromCivil(year, 1, 1) + change.day_;
+    } else {
+      auto month{ static_cast<unsigned>(change.month_) };
+      int64_t first{ daysFromCivil(year, month, 1) };
+      // 1970-01-01 was a Thursday
+      int64_t weekday{ ((first + 4) % 7 + 7) % 7 };
+      day = first + (change.day_ - weekday + 7) % 7 + (change.week_ - 1) * 7;
+      if (day >= first + daysInMonth(year, month))
+        day -= 7;
+    }
+    return day * 86400 + change.time_ - offset;
+  }
+
+  int32_t offsetAt(int64_t seconds) const {
+    if (!has_dst_)
+      return std_offset_;
+    int64_t year{ civilFromDays(floorDiv(seconds, 86400)).year_ };
+    int64_t start{ changeTime(year, start_, std_offset_) };
+    int64_t end{ changeTime(year, end_, dst_offset_) };
+    // Southern hemisphere rules have DST across the new year
+    bool dst{ start <= end ? seconds >= start && seconds < end
+                           : seconds >= start || seconds < end };
+    return dst ? dst_offset_ : std_offset_;
+  }
+};
+
+// Reads 1 to max_digits digits at pos, advancing it
+inline bool readTzNumber(std::string_view str, size_t& pos, size_t max_digits,
+                         int& value) {
+  size_t start{ pos };
+  int result{ 0 };
+  while (pos < str.size() && pos - start < max_digits && str[pos] >= '0' &&
+         str[pos] <= '9') {
+    result = result * 10 + (str[pos++] - '0');
+  }
+  value = result;
+  return pos != start;
+}
+
+// "EST" or "<+0530>"
+inline bool readTzName(std::string_view str, size_t& pos) {
+  if (pos < str.size() && str[pos] == '<') {
+    size_t close{ str.find('>', pos) };
+    if (close == std::string_view::npos)
+      return false;
+    pos = close + 1;
+    return true;
+  }
+  size_t start{ pos };
+  while (pos < str.size() && ((str[pos] >= 'A' && str[pos] <= 'Z') ||
+                              (str[pos] >= 'a' && str[pos] <= 'z'))) {
+    ++pos;
+  }
+  return pos - start >= 3;
+}
+
+// "[+|-]hh[:mm[:ss]]" in seconds, as written (POSIX offsets count west)
+inline bool readTzTime(std::string_view str, size_t& pos, int32_t& seconds) {
+  bool negative{ false };
+  if (pos < str.size() && (str[pos] == '+' || str[pos] == '-'))
+    negative = str[pos++] == '-';
+  int hours, minutes{ 0 }, secs{ 0 };
+  if (!readTzNumber(str, pos, 3, hours) || hours > 167)
+    return false;
+  if (pos < str.size() && str[pos] == ':') {
+    ++pos;
+    if (!readTzNumber(str, pos, 2, minutes) || minutes > 59)
+      return false;
+    if (pos < str.size() && str[pos] == ':') {
+      ++pos;
+      if (!readTzNumber(str, pos, 2, secs) || secs > 59)
+        return false;
+    }
+  }
+  seconds = hours * 3600 + minutes * 60 + secs;
+  if (negative)
+    seconds = -seconds;
+  return true;
+}
+
+inline bool readTzChange(std::string_view str, size_t& pos,
+                         TzRule::Change& change) {
+  if (pos >= str.size())
+    return false;
+  if (str[pos] == 'M') {
+    ++pos;
+    change.kind_ = TzRule::ChangeKind::MONTH_WEEK_DAY;
+    if (!readTzNumber(str, pos, 2, change.month_) || pos >= str.size() ||
+        str[pos++] != '.' || !readTzNumber(str, pos, 1, change.week_) ||
+        pos >= str.size() || str[pos++] != '.' ||
+        !readTzNumber(str, pos, 1, change.day_)) {
+      return false;
+    }
+    if (change.month_ < 1 || change.month_ > 12 || change.week_ < 1 ||
+        change.week_ > 5 || change.day_ > 6) {
+      return false;
+    }
+  } else if (str[pos] == 'J') {
+    ++pos;
+    change.kind_ = TzRule::ChangeKind::JULIAN;
+    if (!readTzNumber(str, pos, 3, change.day_) || change.day_ < 1 ||
+        change.day_ > 365) {
+      return false;
+    }
+  } else {
+    change.kind_ = TzRule::ChangeKind::ZERO_BASED;
+    if (!readTzNumber(str, pos, 3, change.day_) || change.day_ > 365)
+      return false;
+  }
+  change.time_ = 7200;
+  if (pos < str.size() && str[pos] == '/') {
+    ++pos;
+    return readTzTime(str, pos, change.time_);
+  }
+  return true;
+}
+
+inline bool parseTzRule(std::string_view str, TzRule& rule) {
+  size_t pos{ 0 };
+  int32_t offset;
+  if (!readTzName(str, pos) || !readTzTime(str, pos, offset))
+    return false;
+  rule = TzRule{};
+  rule.std_offset_ = -offset;
+  if (pos == str.size())
+    return true;
+  if (!readTzName(str, pos))
+    return false;
+  rule.has_dst_ = true;
+  rule.dst_offset_ = rule.std_offset_ + 3600;
+  if (pos < str.size() && str[pos] != ',') {
+    if (!readTzTime(str, pos, offset))
+      return false;
+    rule.dst_offset_ = -offset;
+  }
+  if (pos == str.size()) {
+    // No rule given: the US one, as glibc assumes
+    rule.start_ = { TzRule::ChangeKind::MONTH_WEEK_DAY, 3, 2, 0, 7200 };
+    rule.end_ = { TzRule::ChangeKind::MONTH_WEEK_DAY, 11, 1, 0, 7200 };
+    return true;
+  }
+  return str[pos++] == ',' && readTzChange(str, pos, rule.start_) &&
+         pos < str.size() && str[pos++] == ',' &&
+         readTzChange(str, pos, rule.end_) && pos == str.size();
+}
+}  // namespace internal
+
+// UTC offsets of a time zone from its TZif file (RFC 8536, as installed
+// under /usr/share/zoneinfo), without localtime_r and the libc tz lock.
+// The transition table is an immutable snapshot behind an atomic pointer:
+// offsetAt() is a lock-free binary search, and load()/reload() swap in a
+// new snapshot while readers keep using the old one. Replaced snapshots
+// are kept until the TimeZone is destroyed, so each reload costs the size
+// of one table. Times after the last transition follow the file's POSIX
+// TZ footer rule.
+//
+//   int32_t offset{ hlp::TimeZone::local().offsetAt(seconds) };
+//   hlp::TimeZone::local().reload();  // after a tzdata update
+class TimeZone : public NonCopyable {
+ public:
+  // Zone of the process: $TZ (a zoneinfo name, a path or a POSIX rule,
+  // optionally after ':'), /etc/localtime if TZ is unset, else UTC
+  static TimeZone& local() {
+    static TimeZone zone{ std::string() };
+    return zone;
+  }
+
+  // An empty name is the process's zone, as for local()
+  explicit TimeZone(const std::string& name) : spec_(name) {
+    if (!load(name)) {
+      auto utc{ std::make_unique<Snapshot>() };
+      utc->name_ = "UTC";
+      install(std::move(utc));
+    }
+  }
+
+  // Reads name's zone and swaps it in; false keeps the current one
+  bool load(const std::string& name) {
+    auto snapshot{ std::make_unique<Snapshot>() };
+    if (!read(name, *snapshot))
+      return false;
+    std::lock_guard<std::mutex> lock(mutex_);
+    spec_ = name;
+    install(std::move(snapshot));
+    return true;
+  }
+
+  // Loads the zone again, picking up tzdata updates and, for local(), a
+  // changed $TZ
+  bool reload() {
+    std::string spec;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      spec = spec_;
+    }
+    return load(spec);
+  }
+
+  // Resolved name of the zone in use
+  const std::string& name() const {
+    return current().name_;
+  }
+
+  // Seconds east of UTC at UTC time seconds
+  int32_t offsetAt(int64_t seconds) const {
+    const Snapshot& zone{ current() };
+    const auto& times{ zone.transitions_ };
+    if (zone.has_rule_ && (times.empty() || seconds >= times.back()))
+      return zone.rule_.offsetAt(seconds);
+    auto it{ std::upper_bound(times.begin(), times.end(), seconds) };
+    if (it == times.begin())
+      return zone.initial_offset_;
+    return zone.offsets_[it - times.begin() - 1];
+  }
+
+  // Offset to subtract from local wall-clock seconds to get UTC. A time
+  // skipped by a forward change resolves with the offset before it, a
+  // repeated time to its first occurrence.
+  int32_t offsetAtLocal(int64_t local_seconds) const {
+    int32_t before{ offsetAt(local_seconds - 86400) };
+    int32_t after{ offsetAt(local_seconds + 86400) };
+    if (before == after || offsetAt(local_seconds - before) == before)
+      return before;
+    return offsetAt(local_seconds - after) == after ? after : before;
+  }
+
+  int64_t toLocalMicroSeconds(int64_t micro_seconds) const {
+    int32_t offset{ offsetAt(internal::floorDiv(micro_seconds, 1000000)) };
+    return micro_seconds + static_cast<int64_t>(offset) * 1000000;
+  }
+
+ private:
+  struct Snapshot {
+    std::string name_;
+    // UTC seconds, ascending, and the offset from each on
+    std::vector<int64_t> transitions_;
+    std::vector<int32_t> offsets_;
+    int32_t initial_offset_{ 0 };
+    bool has_rule_{ false };
+    internal::TzRule rule_;
+  };
+
+  const Snapshot& current() const {
+    return *snapshot_.load(std::memory_order_acquire);
+  }
+
+  // Called with mutex_ held, or from the constructor
+  void install(std::unique_ptr<Snapshot> snapshot) {
+    snapshot_.store(snapshot.get(), std::memory_order_release);
+    snapshots_.push_back(std::move(snapshot));
+  }
+
+  static bool read(const std::string& name, Snapshot& snapshot) {
+    std::string spec{ name };
+    if (spec.empty()) {
+      const char* env{ getenv("TZ") };
+      if (!env) {
+        return readFile("/etc/localtime", snapshot) ||
+               readRule("UTC0", snapshot);
+      }
+      spec = env;
+      if (spec.empty())
+        return readRule("UTC0", snapshot);
+    }
+    if (spec[0] == ':')
+      spec.erase(0, 1);
+    snapshot.name_ = spec;
+    if (!spec.empty() && spec[0] == '/')
+      return readFile(spec, snapshot);
+    const char* dir{ getenv("TZDIR") };
+    std::string path{ dir ? dir : "/usr/share/zoneinfo" };
+    if (spec.find("..") == std::string::npos &&
+        readFile(path + "/" + spec, snapshot)) {
+      return true;
+    }
+    return readRule(spec, snapshot);
+  }
+
+  static bool readRule(std::string_view spec, Snapshot& snapshot) {
+    if (!internal::parseTzRule(spec, snapshot.rule_))
+      return false;
+    if (snapshot.name_.empty())
+      snapshot.name_ = "UTC";
+    snapshot.has_rule_ = true;
+    snapshot.initial_offset_ = snapshot.rule_.std_offset_;
+    return true;
+  }
+
+  static bool readFile(const std::string& path, Snapshot& snapshot) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+      return false;
+    std::string data{ std::istreambuf_iterator<char>(in),
+                      std::istreambuf_iterator<char>() };
+    Snapshot parsed;
+    parsed.name_ = snapshot.name_.empty() ? path : snapshot.name_;
+    if (!parseTzif(data, parsed))
+      return false;
+    snapshot = std::move(parsed);
+    return true;
+  }
+
+  static uint32_t readBig32(const char* p) {
+    auto b{ reinterpret_cast<const unsigned char*>(p) };
+    return static_cast<uint32_t>(b[0]) << 24 |
+           static_cast<uint32_t>(b[1]) << 16 |
+           static_cast<uint32_t>(b[2]) << 8 | b[3];
+  }
+
+  static uint64_t readBig64(const char* p) {
+    return static_cast<uint64_t>(readBig32(p)) << 32 | readBig32(p + 4);
+  }
+
+  static bool parseTzif(std::string_view data, Snapshot& snapshot) {
+    constexpr size_t kHeaderSize{ 44 };
+    // isutcnt, isstdcnt, leapcnt, timecnt, typecnt, charcnt
+    size_t counts[6];
+    auto readHeader{ [&](size_t pos) {
+      if (data.size() - pos < kHeaderSize || data.substr(pos, 4) != "TZif")
+        return false;
+      for (size_t i = 0; i < 6; ++i) {
+        counts[i] = readBig32(data.data() + pos + 20 + 4 * i);
+      }
+      return true;
+    } };
+    auto blockSize{ [&](size_t time_size) {
+      return counts[3] * time_size + counts[3] + counts[4] * 6 + counts[5] +
+             counts[2] * (time_size + 4) + counts[1] + counts[0];
+    } };
+
+    if (data.size() < kHeaderSize || !readHeader(0))
+      return false;
+    char version{ data[4] };
+    size_t pos{ kHeaderSize };
+    size_t time_size{ 4 };
+    if (version >= '2') {
+      // Skip the 32-bit block for the 64-bit one that follows
+      pos += blockSize(4);
+      if (pos > data.size() || !readHeader(pos))
+        return false;
+      pos += kHeaderSize;
+      time_size = 8;
+    }
+    size_t time_count{ counts[3] }, type_count{ counts[4] };
+    if (type_count == 0 || data.size() - pos < blockSize(time_size))
+      return false;
+
+    const char* times{ data.data() + pos };
+    const char* indices{ times + time_count * time_size };
+    const char* types{ indices + time_count };
+    std::vector<int32_t> type_offsets(type_count);
+    for (size_t i = 0; i < type_count; ++i) {
+      type_offsets[i] = static_cast<int32_t>(readBig32(types + 6 * i));
+    }
+    snapshot.initial_offset_ = type_offsets[0];
+    snapshot.transitions_.reserve(time_count);
+    snapshot.offsets_.reserve(time_count);
+    for (size_t i = 0; i < time_count; ++i) {
+      auto index{ static_cast<unsigned char>(indices[i]) };
+      if (index >= type_count)
+        return false;
+      int64_t time{ time_size == 8
+                            ? static_cast<int64_t>(readBig64(times + 8 * i))
+                            : static_cast<int32_t>(readBig32(times + 4 * i)) };
+      snapshot.transitions_.push_back(time);
+      snapshot.offsets_.push_back(type_offsets[index]);
+    }
+
+    // "\n<POSIX TZ rule>\n" governs times after the last transition
+    pos += blockSize(time_size);
+    if (version >= '2' && pos < data.size() && data[pos] == '\n') {
+      size_t end{ data.find('\n', pos + 1) };
+      if (end != std::string_view::npos && end > pos + 1 &&
+          internal::parseTzRule(data.substr(pos + 1, end - pos - 1),
+                                snapshot.rule_)) {
+        snapshot.has_rule_ = true;
+      }
+    }
+    return true;
+  }
+
+  std::atomic<const Snapshot*> snapshot_{ nullptr };
+  std::mutex mutex_;
+  std::string spec_;
+  std::vector<std::unique_ptr<const Snapshot>> snapshots_;
+};
+
+}  // namespace hlp
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define HLP_HAS_TSC 1
+#endif
+#include "non_copyable.h"
+
+namespace hlp {
+
+// Wall clock read from the CPU timestamp counter. The tick rate is
+// calibrated once against CLOCK_MONOTONIC. All threads extrapolate from
+// one (tsc, realtime) anchor published under a seqlock, so their readings
+// are comparable; the first reader to find it older than kResyncNanos
+// re-anchors with clock_gettime, so readings track NTP adjustments within
+// that window. A thread never reads less than it read before, even when a
+// re-anchor steps the clock back. On CPUs without an invariant TSC every
+// call goes to clock_gettime (vDSO).
+class TscClock : public NonCopyable {
+ public:
+  static constexpr int64_t kResyncNanos{ 1000000000 };
+
+  static TscClock& instance() {
+    static TscClock clock;
+    return clock;
+  }
+
+  bool usesTsc() const {
+    return ns_per_tick_ > 0;
+  }
+
+  double ticksPerNano() const {
+    return usesTsc() ? 1.0 / ns_per_tick_ : 0;
+  }
+
+  int64_t nanoSecondsSinceEpoch() const {
+#ifdef HLP_HAS_TSC
+    if (usesTsc()) {
+      thread_local int64_t last_nanos{ 0 };
+      int64_t nanos{ tscNanos() };
+      if (nanos < last_nanos)
+        return last_nanos;
+      last_nanos = nanos;
+      return nanos;
+    }
+#endif
+    return realtimeNanos();
+  }
+
+  int64_t microSecondsSinceEpoch() const {
+    return nanoSecondsSinceEpoch() / 1000;
+  }
+
+ private:
+  TscClock() {
+#ifdef HLP_HAS_TSC
+    if (invariantTsc()) {
+      calibrate();
+      anchor_tsc_.store(__rdtsc(), std::memory_order_relaxed);
+      anchor_nanos_.store(realtimeNanos(), std::memory_order_relaxed);
+    }
+#endif
+  }
+
+  static int64_t clockNanos(clockid_t id) {
+    timespec ts;
+    clock_gettime(id, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  }
+
+  static int64_t realtimeNanos() {
+    return clockNanos(CLOCK_REALTIME);
+  }
+
+#ifdef HLP_HAS_TSC
+  static bool invariantTsc() {
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+      return false;
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return (edx & (1u << 8)) != 0;
+  }
+
+  // Busy-waits about 10 ms once per process
+  void calibrate() {
+    constexpr int64_t kCalibrationNanos{ 10000000 };
+    int64_t start_ns{ clockNanos(CLOCK_MONOTONIC) };
+    uint64_t start_tsc{ __rdtsc() };
+    int64_t end_ns;
+    do {
+      end_ns = clockNanos(CLOCK_MONOTONIC);
+    } while (end_ns - start_ns < kCalibrationNanos);
+    uint64_t end_tsc{ __rdtsc() };
+    if (end_tsc > start_tsc) {
+      ns_per_tick_ = static_cast<double>(end_ns - start_ns) /
+                     static_cast<double>(end_tsc - start_tsc);
+    }
+  }
+
+  int64_t tscNanos() const {
+    uint32_t seq;
+    uint64_t base_tsc;
+    int64_t base_nanos;
+    do {
+      seq = anchor_seq_.load(std::memory_order_acquire);
+      // Being re-anchored: don't wait for the writer
+      if (seq & 1)
+        return realtimeNanos();
+      base_tsc = anchor_tsc_.load(std::memory_order_acquire);
+      base_nanos = anchor_nanos_.load(std::memory_order_acquire);
+    } while (anchor_seq_.load(std::memory_order_relaxed) != seq);
+
+    auto elapsed{ static_cast<int64_t>(
+            static_cast<double>(static_cast<int64_t>(__rdtsc() - base_tsc)) *
+            ns_per_tick_) };
+    if (elapsed > kResyncNanos &&
+        anchor_seq_.compare_exchange_strong(seq, seq + 1,
+                                            std::memory_order_relaxed)) {
+      uint64_t tsc{ __rdtsc() };
+      int64_t nanos{ realtimeNanos() };
+      anchor_tsc_.store(tsc, std::memory_order_release);
+      anchor_nanos_.store(nanos, std::memory_order_release);
+      anchor_seq_.store(seq + 2, std::memory_order_release);
+      return nanos;
+    }
+    return base_nanos + elapsed;
+  }
+#endif
+
+  double ns_per_tick_{ 0 };
+  // Seqlock: odd while the anchor is being replaced
+  mutable std::atomic<uint32_t> anchor_seq_{ 0 };
+  mutable std::atomic<uint64_t> anchor_tsc_{ 0 };
+  mutable std::atomic<int64_t> anchor_nanos_{ 0 };
+};
+
+}  // namespace hlp
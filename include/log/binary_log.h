@@ -0,0 +1,617 @@
+#pragma once
+
+#include <atomic>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <functional>
+#include <thread>
+#endif
+#include "hlp/number_format.h"
+#include "log_stager.h"
+#include "logger.h"
+
+namespace hlp {
+
+// Deferred-formatting log records. A call site's format string, file, line
+// and argument types are registered once; each record then carries only a
+// small header and the raw argument bytes, and BinaryLogDecoder (or the
+// hlp-log-decode tool) renders the text offline in Logger's layout.
+//
+// Stream layout, all integers in host byte order:
+//   record     BinaryRecordHeader, then the arguments
+//   definition BinaryRecordHeader with kBinaryDefinitionFlag in site_, then
+//              level:u8 line:u32 nargs:u8 types:u8[nargs]
+//              file_len:u16 file format_len:u32 format
+//   marker     BinaryRecordHeader with site_ kBinaryStreamMarker, the
+//              time in micro_seconds_; starts a segment
+// Site ids are only unique within a process, so a stager writing to a file
+// sink starts its output, and every new file of a rotating sink, with a
+// marker and all definitions; a file appended to by several runs holds one
+// segment per run. A site's definition is also staged together with its
+// first record in each stager it is logged to, and again after a site that
+// shares the stager's slot took it over. The decoder resolves records
+// against the definitions of their own segment, read ahead of its records
+// (a day rotation writes the batch that triggered it ahead of the new
+// file's marker, so records before a stream's first marker belong to the
+// segment it starts).
+// Format strings use "{}" placeholders; "{{" and "}}" are literal braces.
+enum class BinaryArgType : uint8_t {
+  INT32,
+  INT64,
+  UINT32,
+  UINT64,
+  DOUBLE,
+  CHAR,
+  BOOL,
+  STRING,
+  POINTER
+};
+
+struct BinaryRecordHeader {
+  uint32_t size_;
+  uint32_t site_;
+  int64_t micro_seconds_;
+  uint32_t thread_id_;
+  uint32_t reserved_;
+};
+
+inline constexpr uint32_t kBinaryDefinitionFlag{ 0x80000000u };
+inline constexpr uint32_t kBinaryStreamMarker{ 0 };
+
+// Static metadata of one call site, constant-initialized by the LOG_*_BIN
+// macros; id_ is assigned on first use. stagers_ remembers the stagers the
+// definition has been staged in, a few at a time.
+struct BinaryLogSite {
+  static constexpr size_t kStagerSlots{ 4 };
+
+  constexpr BinaryLogSite(const char* format, const char* file, int line,
+                          Logger::LogLevel level)
+          : format_(format), file_(file), line_(line), level_(level) {
+  }
+
+  bool isDefinedIn(uint64_t stager_id) const {
+    for (auto& slot : stagers_) {
+      if (slot.load(std::memory_order_acquire) == stager_id)
+        return true;
+    }
+    return false;
+  }
+
+  void setDefinedIn(uint64_t stager_id) {
+    for (auto& slot : stagers_) {
+      uint64_t empty{ 0 };
+      if (slot.compare_exchange_strong(empty, stager_id,
+                                       std::memory_order_release) ||
+          empty == stager_id) {
+        return;
+      }
+    }
+    stagers_[stager_id % kStagerSlots].store(stager_id,
+                                             std::memory_order_release);
+  }
+
+  const char* format_;
+  const char* file_;
+  int line_;
+  Logger::LogLevel level_;
+  std::atomic<uint32_t> id_{ 0 };
+  std::atomic<uint64_t> stagers_[kStagerSlots]{};
+};
+
+namespace detail {
+struct BinaryPointer {
+  uint64_t value_;
+};
+
+// Normalizes an argument to the value stored on the wire
+template <typename T>
+auto binaryWireValue(const T& v) {
+  using U = std::decay_t<T>;
+  if constexpr (std::is_same_v<U, bool> || std::is_same_v<U, char>) {
+    return v;
+  } else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>) {
+    if constexpr (sizeof(U) <= sizeof(int32_t)) {
+      return static_cast<int32_t>(v);
+    } else {
+      return static_cast<int64_t>(v);
+    }
+  } else if constexpr (std::is_integral_v<U>) {
+    if constexpr (sizeof(U) <= sizeof(uint32_t)) {
+      return static_cast<uint32_t>(v);
+    } else {
+      return static_cast<uint64_t>(v);
+    }
+  } else if constexpr (std::is_floating_point_v<U>) {
+    return static_cast<double>(v);
+  } else if constexpr (std::is_array_v<T>) {
+    return std::string_view(v);
+  } else if constexpr (std::is_same_v<U, const char*> ||
+                       std::is_same_v<U, char*>) {
+    return v ? std::string_view(v) : std::string_view("(null)");
+  } else if constexpr (std::is_convertible_v<const U&, std::string_view>) {
+    return std::string_view(v);
+  } else if constexpr (std::is_pointer_v<U>) {
+    return BinaryPointer{ reinterpret_cast<uintptr_t>(v) };
+  } else {
+    static_assert(std::is_pointer_v<U>, "type can't be logged in binary");
+  }
+}
+
+template <typename W>
+constexpr BinaryArgType binaryArgType() {
+  if constexpr (std::is_same_v<W, int32_t>) {
+    return BinaryArgType::INT32;
+  } else if constexpr (std::is_same_v<W, int64_t>) {
+    return BinaryArgType::INT64;
+  } else if constexpr (std::is_same_v<W, uint32_t>) {
+    return BinaryArgType::UINT32;
+  } else if constexpr (std::is_same_v<W, uint64_t>) {
+    return BinaryArgType::UINT64;
+  } else if constexpr (std::is_same_v<W, double>) {
+    return BinaryArgType::DOUBLE;
+  } else if constexpr (std::is_same_v<W, char>) {
+    return BinaryArgType::CHAR;
+  } else if constexpr (std::is_same_v<W, bool>) {
+    return BinaryArgType::BOOL;
+  } else if constexpr (std::is_same_v<W, std::string_view>) {
+    return BinaryArgType::STRING;
+  } else {
+    return BinaryArgType::POINTER;
+  }
+}
+
+inline size_t binaryArgSize(std::string_view v) {
+  return sizeof(uint32_t) + v.size();
+}
+
+template <typename W>
+constexpr size_t binaryArgSize(const W&) {
+  return sizeof(W);
+}
+
+inline char* binaryEncode(char* p, std::string_view v) {
+  auto len{ static_cast<uint32_t>(v.size()) };
+  memcpy(p, &len, sizeof(len));
+  memcpy(p + sizeof(len), v.data(), v.size());
+  return p + sizeof(len) + v.size();
+}
+
+template <typename W>
+char* binaryEncode(char* p, const W& v) {
+  memcpy(p, &v, sizeof(W));
+  return p + sizeof(W);
+}
+
+inline uint32_t binaryThreadId() {
+  thread_local uint32_t tid = []() {
+#if defined(__linux__)
+    return static_cast<uint32_t>(::syscall(SYS_gettid));
+#else
+    return static_cast<uint32_t>(
+            std::hash<std::thread::id>()(std::this_thread::get_id()));
+#endif
+  }();
+  return tid;
+}
+
+// The site static lives in a template keyed by the closure type of Make, so
+// a statement discarded by HLP_LOG_ACTIVE_ never instantiates it
+template <typename Make>
+BinaryLogSite& binaryLogSite(Make make) {
+  static BinaryLogSite site(make());
+  return site;
+}
+}  // namespace detail
+
+class BinaryLogger {
+ public:
+  template <typename... Args>
+  static void log(LogStager& stager, BinaryLogSite& site,
+                  const Args&... args) {
+    if (site.isDefinedIn(stager.id())) {
+      write(stager, site.id_.load(std::memory_order_acquire), site.level_,
+            nullptr, detail::binaryWireValue(args)...);
+    } else {
+      define<decltype(detail::binaryWireValue(args))...>(
+              stager, site, detail::binaryWireValue(args)...);
+    }
+    if (site.level_ == Logger::LogLevel::FATAL) {
+      stager.flush();
+    }
+  }
+
+  // A segment marker and every definition registered so far, for
+  // LogStager::setStreamHeader()
+  static void appendDefinitions(std::string& header) {
+    BinaryRecordHeader marker{ sizeof(BinaryRecordHeader), kBinaryStreamMarker,
+                               Date::now().microSecondsSinceEpoch(),
+                               detail::binaryThreadId(), 0 };
+    header.append(reinterpret_cast<const char*>(&marker), sizeof(marker));
+    std::lock_guard<std::mutex> lock(registryMutex());
+    for (auto& def : definitions()) {
+      header += def;
+    }
+  }
+
+ protected:
+  // Stages the definition and the record as one unit, so both are kept or
+  // both spilled or dropped. The site only counts as defined in the stager
+  // once that unit is staged and harvested: records other threads then
+  // write to it can't reach the file ahead of the definition.
+  template <typename... Ws>
+  static void define(LogStager& stager, BinaryLogSite& site,
+                     const Ws&... values) {
+    const std::string* def{ nullptr };
+    uint32_t id{ registerSite<Ws...>(site, def) };
+    stager.setStreamHeader(&BinaryLogger::appendDefinitions);
+    if (write(stager, id, site.level_, def, values...)) {
+      stager.flush();
+      site.setDefinedIn(stager.id());
+    }
+  }
+
+  // Returns false if the record went to the overflow policy
+  template <typename... Ws>
+  static bool write(LogStager& stager, uint32_t id, int level,
+                    const std::string* def, const Ws&... values) {
+    size_t def_size{ def ? def->size() : 0 };
+    size_t size{ sizeof(BinaryRecordHeader) };
+    ((size += detail::binaryArgSize(values)), ...);
+    std::string spill;
+    char* buf{ stager.reserve(def_size + size, level) };
+    char* p{ buf };
+    if (!p) {
+      spill.resize(def_size + size);
+      p = &spill[0];
+    }
+    if (def) {
+      memcpy(p, def->data(), def_size);
+      p += def_size;
+    }
+    BinaryRecordHeader header{ static_cast<uint32_t>(size), id,
+                               Date::now().microSecondsSinceEpoch(),
+                               detail::binaryThreadId(), 0 };
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+    ((p = detail::binaryEncode(p, values)), ...);
+    if (buf) {
+      stager.commit(def_size + size);
+      return true;
+    }
+    return stager.output(spill.data(), def_size + size, level);
+  }
+
+  // Shared by every registerSite instantiation
+  static std::mutex& registryMutex() {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  // Indexed by site id - 1; a deque keeps handed out references valid
+  static std::deque<std::string>& definitions() {
+    static std::deque<std::string> defs;
+    return defs;
+  }
+
+  template <typename... Ws>
+  static uint32_t registerSite(BinaryLogSite& site, const std::string*& def) {
+    static_assert(sizeof...(Ws) <= UINT8_MAX, "too many arguments");
+    std::lock_guard<std::mutex> lock(registryMutex());
+    uint32_t id{ site.id_.load(std::memory_order_relaxed) };
+    if (id != 0) {
+      def = &definitions()[id - 1];
+      return id;
+    }
+    id = static_cast<uint32_t>(definitions().size() + 1);
+
+    const char* slash{ strrchr(site.file_, '/') };
+    std::string_view file{ slash ? slash + 1 : site.file_ };
+    std::string_view format{ site.format_ };
+    const uint8_t types[sizeof...(Ws) + 1]{ static_cast<uint8_t>(
+            detail::binaryArgType<Ws>())... };
+    auto nargs{ static_cast<uint8_t>(sizeof...(Ws)) };
+    auto level{ static_cast<uint8_t>(site.level_) };
+    auto line{ static_cast<uint32_t>(site.line_) };
+    auto file_len{ static_cast<uint16_t>(file.size()) };
+    auto format_len{ static_cast<uint32_t>(format.size()) };
+
+    std::string blob(sizeof(BinaryRecordHeader), '\0');
+    blob.append(reinterpret_cast<const char*>(&level), sizeof(level));
+    blob.append(reinterpret_cast<const char*>(&line), sizeof(line));
+    blob.append(reinterpret_cast<const char*>(&nargs), sizeof(nargs));
+    blob.append(reinterpret_cast<const char*>(types), nargs);
+    blob.append(reinterpret_cast<const char*>(&file_len), sizeof(file_len));
+    blob.append(file.data(), file_len);
+    blob.append(reinterpret_cast<const char*>(&format_len),
+                sizeof(format_len));
+    blob.append(format.data(), format.size());
+    BinaryRecordHeader header{ static_cast<uint32_t>(blob.size()),
+                               id | kBinaryDefinitionFlag, 0, 0, 0 };
+    memcpy(&blob[0], &header, sizeof(header));
+    definitions().push_back(std::move(blob));
+
+    def = &definitions().back();
+    site.id_.store(id, std::memory_order_release);
+    return id;
+  }
+};
+
+// Rebuilds text records from a binary log stream
+class BinaryLogDecoder {
+ public:
+  void setDisplayLocalTime(bool local) {
+    local_ = local;
+  }
+
+  // Decodes a complete stream, one file; returns false if it is truncated
+  // or refers to sites its segment does not define
+  bool decode(std::string_view data, std::string& out) {
+    bool ok{ true };
+    while (!data.empty()) {
+      std::string_view segment{ data.substr(0, segmentLength(data)) };
+      data.remove_prefix(segment.size());
+      sites_.clear();
+      ok = scan(segment, true, out) && ok;
+      ok = scan(segment, false, out) && ok;
+    }
+    return ok;
+  }
+
+ protected:
+  struct Site {
+    uint8_t level_;
+    uint32_t line_;
+    std::vector<BinaryArgType> types_;
+    std::string file_;
+    std::string format_;
+  };
+
+  template <typename T>
+  static bool read(std::string_view& data, T& v) {
+    if (data.size() < sizeof(T))
+      return false;
+    memcpy(&v, data.data(), sizeof(T));
+    data.remove_prefix(sizeof(T));
+    return true;
+  }
+
+  static bool read(std::string_view& data, std::string& v, size_t len) {
+    if (data.size() < len)
+      return false;
+    v.assign(data.data(), len);
+    data.remove_prefix(len);
+    return true;
+  }
+
+  // Length of the segment data starts with: up to the marker after its
+  // first one, or everything if a header is corrupt
+  static size_t segmentLength(std::string_view data) {
+    size_t pos{ 0 };
+    bool marked{ false };
+    BinaryRecordHeader header;
+    while (data.size() - pos >= sizeof(header)) {
+      memcpy(&header, data.data() + pos, sizeof(header));
+      if (header.size_ < sizeof(header) || header.size_ > data.size() - pos)
+        break;
+      if (header.site_ == kBinaryStreamMarker) {
+        if (marked)
+          return pos;
+        marked = true;
+      }
+      pos += header.size_;
+    }
+    return data.size();
+  }
+
+  bool scan(std::string_view data, bool definitions, std::string& out) {
+    while (!data.empty()) {
+      BinaryRecordHeader header;
+      if (data.size() < sizeof(header))
+        return false;
+      memcpy(&header, data.data(), sizeof(header));
+      if (header.size_ < sizeof(header) || header.size_ > data.size())
+        return false;
+      std::string_view body{ data.substr(sizeof(header),
+                                         header.size_ - sizeof(header)) };
+      data.remove_prefix(header.size_);
+      if (header.site_ == kBinaryStreamMarker)
+        continue;
+      bool is_definition{ (header.site_ & kBinaryDefinitionFlag) != 0 };
+      if (is_definition != definitions)
+        continue;
+      if (is_definition) {
+        if (!readDefinition(header.site_ & ~kBinaryDefinitionFlag, body))
+          return false;
+      } else if (!formatRecord(header, body, out)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool readDefinition(uint32_t id, std::string_view body) {
+    Site site;
+    uint8_t nargs;
+    uint16_t file_len;
+    uint32_t format_len;
+    if (!read(body, site.level_) || !read(body, site.line_) ||
+        !read(body, nargs) || body.size() < nargs)
+      return false;
+    for (uint8_t i = 0; i < nargs; ++i)
+      site.types_.push_back(static_cast<BinaryArgType>(body[i]));
+    body.remove_prefix(nargs);
+    if (!read(body, file_len) || !read(body, site.file_, file_len) ||
+        !read(body, format_len) || !read(body, site.format_, format_len))
+      return false;
+    sites_[id] = std::move(site);
+    return true;
+  }
+
+  bool formatRecord(const BinaryRecordHeader& header, std::string_view body,
+                    std::string& out) {
+    auto it{ sites_.find(header.site_) };
+    if (it == sites_.end())
+      return false;
+    const Site& site{ it->second };
+    static constexpr const char* kLevelStrings[]{ "TRACE ", "DEBUG ",
+                                                  "INFO  ", "WARN  ",
+                                                  "ERROR ", "FATAL " };
+    formatTime(header.micro_seconds_, out);
+    out += std::to_string(header.thread_id_);
+    out += ' ';
+    out += site.level_ < Logger::NUMBER_OF_LOG_LEVELS
+                   ? kLevelStrings[site.level_]
+                   : "?     ";
+
+    std::string_view format{ site.format_ };
+    size_t arg{ 0 };
+    while (!format.empty()) {
+      if (format.size() >= 2 && (format.substr(0, 2) == "{{" ||
+                                 format.substr(0, 2) == "}}")) {
+        out += format[0];
+        format.remove_prefix(2);
+      } else if (format.size() >= 2 && format.substr(0, 2) == "{}" &&
+                 arg < site.types_.size()) {
+        if (!formatArg(site.types_[arg++], body, out))
+          return false;
+        format.remove_prefix(2);
+      } else {
+        out += format[0];
+        format.remove_prefix(1);
+      }
+    }
+    for (; arg < site.types_.size(); ++arg) {
+      out += ' ';
+      if (!formatArg(site.types_[arg], body, out))
+        return false;
+    }
+    out += " - ";
+    out += site.file_;
+    out += ':';
+    out += std::to_string(site.line_);
+    out += '\n';
+    return true;
+  }
+
+  static bool formatArg(BinaryArgType type, std::string_view& body,
+                        std::string& out) {
+    char buf[64];
+    switch (type) {
+      case BinaryArgType::INT32: {
+        int32_t v;
+        if (!read(body, v))
+          return false;
+        out += std::to_string(v);
+        return true;
+      }
+      case BinaryArgType::INT64: {
+        int64_t v;
+        if (!read(body, v))
+          return false;
+        out += std::to_string(v);
+        return true;
+      }
+      case BinaryArgType::UINT32: {
+        uint32_t v;
+        if (!read(body, v))
+          return false;
+        out += std::to_string(v);
+        return true;
+      }
+      case BinaryArgType::UINT64: {
+        uint64_t v;
+        if (!read(body, v))
+          return false;
+        out += std::to_string(v);
+        return true;
+      }
+      case BinaryArgType::DOUBLE: {
+        double v;
+        if (!read(body, v))
+          return false;
+        out.append(buf, internal::formatFloat(buf, v));
+        return true;
+      }
+      case BinaryArgType::CHAR: {
+        char v;
+        if (!read(body, v))
+          return false;
+        out += v;
+        return true;
+      }
+      case BinaryArgType::BOOL: {
+        bool v;
+        if (!read(body, v))
+          return false;
+        out += v ? '1' : '0';
+        return true;
+      }
+      case BinaryArgType::STRING: {
+        uint32_t len;
+        if (!read(body, len) || body.size() < len)
+          return false;
+        out.append(body.data(), len);
+        body.remove_prefix(len);
+        return true;
+      }
+      case BinaryArgType::POINTER: {
+        uint64_t v;
+        if (!read(body, v))
+          return false;
+        out.append(buf, static_cast<size_t>(snprintf(buf, sizeof(buf),
+                                                     "0x%" PRIX64, v)));
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void formatTime(int64_t micro_seconds, std::string& out) const {
+    Date date{ micro_seconds };
+    char buf[Date::kMaxFormattedSize];
+    out.append(buf, local_ ? date.formatTimestampLocal(buf, true)
+                           : date.formatTimestamp(buf, true));
+    out.append(local_ ? " " : " UTC ");
+  }
+
+  std::unordered_map<uint32_t, Site> sites_;
+  bool local_{ false };
+};
+
+}  // namespace hlp
+
+#define HLP_LOG_BIN_(stager, level, format, ...)                               \
+  HLP_LOG_ACTIVE_(level)                                                       \
+  LOGGER_IF_(hlp::Logger::logLevel() <= level)                                 \
+  hlp::BinaryLogger::log(                                                      \
+          stager,                                                              \
+          hlp::detail::binaryLogSite([]() {                                    \
+            return hlp::BinaryLogSite{ format, __FILE__, __LINE__, level };    \
+          }),                                                                  \
+          ##__VA_ARGS__)
+
+#define LOG_TRACE_BIN(stager, format, ...)                                     \
+  HLP_LOG_BIN_(stager, hlp::Logger::LogLevel::TRACE, format, ##__VA_ARGS__)
+#define LOG_DEBUG_BIN(stager, format, ...)                                     \
+  HLP_LOG_BIN_(stager, hlp::Logger::LogLevel::DEBUG, format, ##__VA_ARGS__)
+#define LOG_INFO_BIN(stager, format, ...)                                      \
+  HLP_LOG_BIN_(stager, hlp::Logger::LogLevel::INFO, format, ##__VA_ARGS__)
+#define LOG_WARN_BIN(stager, format, ...)                                      \
+  HLP_LOG_BIN_(stager, hlp::Logger::LogLevel::WARN, format, ##__VA_ARGS__)
+#define LOG_ERROR_BIN(stager, format, ...)                                     \
+  HLP_LOG_BIN_(stager, hlp::Logger::LogLevel::ERROR, format, ##__VA_ARGS__)
+#define LOG_FATAL_BIN(stager, format, ...)                                     \
+  HLP_LOG_BIN_(stager, hlp::Logger::LogLevel::FATAL, format, ##__VA_ARGS__)
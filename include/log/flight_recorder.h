@@ -0,0 +1,281 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "log_sink_registry.h"
+
+namespace hlp {
+
+// Keeps the most recent capacity bytes of log text in a ring, for dumping
+// after a crash. write() is a fetch_add on the head plus a memcpy and never
+// touches a file. With a name the ring lives in POSIX shared memory
+// (/dev/shm/<name>) and outlives a crash (it is unlinked on a clean
+// destruction); the head counter sits in the first page, followed by the
+// data. A ring left holding data by a crashed run is continued at its own
+// capacity rather than cleared, so its last records stay readable until
+// they are overwritten; attach() opens one read-only for dumping, as
+// hlp-flight-dump does. Records still being copied when the dump runs may
+// show stale bytes.
+class FlightRecorderSink : public LogSink, public NonCopyable {
+ public:
+  static constexpr size_t kHeaderSize{ 4096 };
+
+  explicit FlightRecorderSink(size_t capacity = 8 * 1024 * 1024,
+                              const std::string& shm_name = {})
+          : capacity_(internal::roundUpPowerOfTwo(
+                    std::max<size_t>(capacity, kHeaderSize))),
+            shm_name_(shm_name) {
+    int fd{ -1 };
+    uint64_t head{ 0 };
+    if (!shm_name_.empty()) {
+      fd = ::shm_open(shm_name_.c_str(), O_RDWR | O_CREAT, 0600);
+      if (fd >= 0 && !previousRing(fd, capacity_, head) &&
+          ::ftruncate(fd, static_cast<off_t>(kHeaderSize + capacity_)) != 0) {
+        ::close(fd);
+        fd = -1;
+      }
+    }
+    if (!map(fd, PROT_READ | PROT_WRITE))
+      throw std::bad_alloc();
+    head_ = new (region_) std::atomic<uint64_t>(head);
+    // Don't run the first record into a line the crash cut short
+    if (head > 0 && data_[(head - 1) & (capacity_ - 1)] != '\n')
+      write("\n", 1);
+  }
+
+  // Read-only view of the ring a recorder left in shared memory, or nullptr
+  // if there is none. write() is a no-op and the segment is kept.
+  static std::unique_ptr<FlightRecorderSink> attach(
+          const std::string& shm_name) {
+    int fd{ ::shm_open(shm_name.c_str(), O_RDONLY, 0) };
+    if (fd < 0)
+      return nullptr;
+    size_t capacity{ 0 };
+    uint64_t head{ 0 };
+    if (!previousRing(fd, capacity, head)) {
+      ::close(fd);
+      return nullptr;
+    }
+    std::unique_ptr<FlightRecorderSink> sink(
+            new FlightRecorderSink(ReadOnly{}, capacity));
+    if (!sink->map(fd, PROT_READ))
+      return nullptr;
+    sink->head_ = reinterpret_cast<std::atomic<uint64_t>*>(sink->region_);
+    return sink;
+  }
+
+  ~FlightRecorderSink() override {
+    if (crashRecorder() == this)
+      crashRecorder() = nullptr;
+    if (region_)
+      ::munmap(region_, kHeaderSize + capacity_);
+    if (!shm_name_.empty())
+      ::shm_unlink(shm_name_.c_str());
+  }
+
+  void write(const char* msg, uint64_t len) override {
+    if (read_only_)
+      return;
+    if (len > capacity_) {
+      msg += len - capacity_;
+      len = capacity_;
+    }
+    uint64_t pos{ head_->fetch_add(len, std::memory_order_relaxed) };
+    size_t offset{ static_cast<size_t>(pos & (capacity_ - 1)) };
+    size_t first{ std::min<size_t>(len, capacity_ - offset) };
+    memcpy(data_ + offset, msg, first);
+    memcpy(data_, msg + first, len - first);
+  }
+
+  size_t capacity() const {
+    return capacity_;
+  }
+
+  uint64_t bytesWritten() const {
+    return head_->load(std::memory_order_relaxed);
+  }
+
+  // Writes the retained text, oldest first, starting at the first complete
+  // line. Only uses write(2), so it is safe in a signal handler.
+  bool dumpTo(int fd) const {
+    uint64_t head{ head_->load(std::memory_order_acquire) };
+    uint64_t begin{ head > capacity_ ? head - capacity_ : 0 };
+    if (begin > 0) {
+      while (begin < head && data_[begin & (capacity_ - 1)] != '\n')
+        ++begin;
+      ++begin;
+    }
+    while (begin < head) {
+      size_t offset{ static_cast<size_t>(begin & (capacity_ - 1)) };
+      size_t len{ static_cast<size_t>(
+              std::min<uint64_t>(head - begin, capacity_ - offset)) };
+      ssize_t n{ ::write(fd, data_ + offset, len) };
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      begin += static_cast<uint64_t>(n);
+    }
+    return true;
+  }
+
+  bool dumpToFile(const char* path) const {
+    int fd{ ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+    if (fd < 0)
+      return false;
+    bool ok{ dumpTo(fd) };
+    ::close(fd);
+    return ok;
+  }
+
+  // Dumps this ring to path on SIGSEGV, SIGABRT, SIGBUS, SIGFPE and SIGILL,
+  // then lets the previous disposition handle the signal
+  void installCrashHandler(const std::string& path) {
+    size_t len{ std::min(path.size(), sizeof(crashPath()) - 1) };
+    memcpy(crashPath(), path.data(), len);
+    crashPath()[len] = '\0';
+    crashRecorder() = this;
+    for (size_t i = 0; i < kCrashSignalCount; ++i) {
+      struct sigaction action;
+      memset(&action, 0, sizeof(action));
+      action.sa_handler = &FlightRecorderSink::crashHandler;
+      sigemptyset(&action.sa_mask);
+      action.sa_flags = SA_ONSTACK;
+      sigaction(kCrashSignals[i], &action, &previousActions()[i]);
+    }
+  }
+
+ private:
+  static constexpr int kCrashSignals[]{ SIGSEGV, SIGABRT, SIGBUS, SIGFPE,
+                                        SIGILL };
+  static constexpr size_t kCrashSignalCount{ sizeof(kCrashSignals) /
+                                             sizeof(kCrashSignals[0]) };
+
+  // For attach(); map() sets up the rest
+  struct ReadOnly {};
+  FlightRecorderSink(ReadOnly, size_t capacity)
+          : capacity_(capacity), read_only_(true) {
+  }
+
+  // Whether the segment behind fd holds a ring with records in it; if so
+  // capacity and head are read from it
+  static bool previousRing(int fd, size_t& capacity, uint64_t& head) {
+    struct stat st;
+    if (::fstat(fd, &st) != 0 ||
+        st.st_size <= static_cast<off_t>(kHeaderSize))
+      return false;
+    size_t size{ static_cast<size_t>(st.st_size) - kHeaderSize };
+    uint64_t value{ 0 };
+    if (internal::roundUpPowerOfTwo(size) != size ||
+        ::pread(fd, &value, sizeof(value), 0) !=
+                static_cast<ssize_t>(sizeof(value)) ||
+        value == 0) {
+      return false;
+    }
+    capacity = size;
+    head = value;
+    return true;
+  }
+
+  // Maps the segment behind fd, or anonymous memory for fd < 0, and closes
+  // fd
+  bool map(int fd, int prot) {
+    void* addr{ ::mmap(nullptr, kHeaderSize + capacity_, prot,
+                       fd >= 0 ? MAP_SHARED : MAP_SHARED | MAP_ANONYMOUS, fd,
+                       0) };
+    if (fd >= 0)
+      ::close(fd);
+    if (addr == MAP_FAILED)
+      return false;
+    region_ = static_cast<char*>(addr);
+    data_ = region_ + kHeaderSize;
+    return true;
+  }
+
+  static FlightRecorderSink*& crashRecorder() {
+    static FlightRecorderSink* recorder{ nullptr };
+    return recorder;
+  }
+
+  static char (&crashPath())[256] {
+    static char path[256];
+    return path;
+  }
+
+  static struct sigaction* previousActions() {
+    static struct sigaction actions[kCrashSignalCount];
+    return actions;
+  }
+
+  static void crashHandler(int sig) {
+    if (FlightRecorderSink* recorder = crashRecorder()) {
+      crashRecorder() = nullptr;
+      recorder->dumpToFile(crashPath());
+    }
+    for (size_t i = 0; i < kCrashSignalCount; ++i) {
+      if (kCrashSignals[i] == sig) {
+        sigaction(sig, &previousActions()[i], nullptr);
+        break;
+      }
+    }
+    raise(sig);
+  }
+
+  size_t capacity_;
+  std::string shm_name_;
+  bool read_only_{ false };
+  char* region_{ nullptr };
+  char* data_{ nullptr };
+  std::atomic<uint64_t>* head_{ nullptr };
+};
+
+// Passes on records at or above a level, read from the level field of
+// Logger's line layout, so e.g. a file sink can keep WARN while a
+// FlightRecorderSink next to it sees DEBUG
+class LevelFilterSink : public LogSink {
+ public:
+  LevelFilterSink(LogSinkPtr sink, Logger::LogLevel min_level)
+          : sink_(std::move(sink)), min_level_(min_level) {
+  }
+
+  void write(const char* msg, uint64_t len) override {
+    if (levelOf(std::string_view(msg, len)) >= min_level_)
+      sink_->write(msg, len);
+  }
+
+  void flush() override {
+    sink_->flush();
+  }
+
+  // Level of a formatted line, FATAL when no level field is found so that
+  // unrecognized output is never dropped
+  static int levelOf(std::string_view line) {
+    static constexpr std::string_view kLevels[]{ " TRACE ", " DEBUG ",
+                                                 " INFO  ", " WARN  ",
+                                                 " ERROR ", " FATAL " };
+    std::string_view head{ line.substr(0, 64) };
+    for (int i = 0; i < Logger::NUMBER_OF_LOG_LEVELS; ++i) {
+      if (head.find(kLevels[i]) != std::string_view::npos)
+        return i;
+    }
+    return Logger::FATAL;
+  }
+
+ private:
+  LogSinkPtr sink_;
+  Logger::LogLevel min_level_;
+};
+
+}  // namespace hlp
@@ -0,0 +1,298 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+#include "log_file_sink.h"
+#include "logger.h"
+
+namespace hlp {
+
+// Durable log writer. Every record gets a ticket (a sequence number); the
+// writer thread collects whatever arrives within maxDelay of the first
+// pending record, or until maxBytes are pending, writes it and issues one
+// fdatasync(2) for the whole group. A ticket is committed once the group
+// holding it is on disk: waitForCommit() blocks for it and onCommit()
+// callbacks run on the writer thread. Records that arrive during an fsync
+// form the next group, so the commit rate adapts to the device. A group
+// whose write loses data (LogFileSink::errors() grows) fails like a failed
+// fdatasync; after either nothing more is reported committed and every
+// pending onCommit() callback runs with committed false.
+//
+//   hlp::GroupCommitLogger audit;
+//   audit.open("/data/audit.log");
+//   audit.start();
+//   uint64_t ticket{ audit.append(msg, len) };
+//   audit.waitForCommit(ticket);
+class GroupCommitLogger : public NonCopyable {
+ public:
+  using CommitCallback = std::function<void(uint64_t ticket, bool committed)>;
+
+  struct Stats {
+    uint64_t records_;
+    uint64_t bytes_;
+    uint64_t commits_;
+    uint64_t errors_;
+    int64_t sync_nanos_;
+    int64_t max_sync_nanos_;
+  };
+
+  explicit GroupCommitLogger(
+          LogFileSinkPtr sink = std::make_shared<PwritevFileSink>())
+          : sink_(std::move(sink)) {
+  }
+  ~GroupCommitLogger() {
+    stop();
+    sink_->close();
+  }
+
+  bool open(const std::string& fullname) {
+    return sink_->open(fullname);
+  }
+
+  // Settings below must be made before start()
+  void setMaxDelay(std::chrono::microseconds delay) {
+    max_delay_ = delay;
+  }
+  void setMaxBytes(size_t bytes) {
+    max_bytes_ = std::max<size_t>(bytes, 1);
+  }
+
+  void start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (thread_ptr_)
+      return;
+    running_ = true;
+    thread_ptr_ = std::make_unique<std::thread>([this]() { threadFunc(); });
+  }
+
+  // Commits everything appended so far, then stops the writer
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!thread_ptr_)
+        return;
+      running_ = false;
+    }
+    cond_.notify_all();
+    thread_ptr_->join();
+    thread_ptr_.reset();
+  }
+
+  // Returns the record's ticket, also kept as lastTicket() of the thread
+  uint64_t append(const char* msg, const uint64_t len) {
+    uint64_t ticket;
+    bool wake;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (buffer_.empty())
+        batch_start_ = std::chrono::steady_clock::now();
+      buffer_.append(msg, len);
+      ticket = ++appended_;
+      // The writer only needs waking to open a group or to close a full one
+      wake = buffer_.size() == len || (buffer_.size() >= max_bytes_ &&
+                                       buffer_.size() - len < max_bytes_);
+    }
+    if (wake)
+      cond_.notify_one();
+    LastTicket& last{ lastTicketSlot() };
+    last.owner_ = this;
+    last.ticket_ = ticket;
+    return ticket;
+  }
+
+  void output(const char* msg, const uint64_t len) {
+    append(msg, len);
+  }
+
+  // Ticket of the calling thread's last append() to this logger, 0 if none;
+  // lets LOG_* call sites wait for their own record
+  uint64_t lastTicket() const {
+    const LastTicket& last{ lastTicketSlot() };
+    return last.owner_ == this ? last.ticket_ : 0;
+  }
+
+  uint64_t committedTicket() const {
+    return committed_.load(std::memory_order_acquire);
+  }
+
+  // Returns true once ticket is on disk, false on timeout, after a failed
+  // write or fdatasync or for a ticket that was never issued
+  template <typename Rep, typename Period>
+  bool waitForCommit(uint64_t ticket,
+                     const std::chrono::duration<Rep, Period>& timeout) {
+    if (committedTicket() >= ticket)
+      return true;
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (ticket > appended_)
+      return false;
+    committed_cond_.wait_for(lock, timeout, [this, ticket]() {
+      return committed_.load(std::memory_order_relaxed) >= ticket || failed_;
+    });
+    return committed_.load(std::memory_order_relaxed) >= ticket;
+  }
+
+  bool waitForCommit(uint64_t ticket) {
+    return waitForCommit(ticket, std::chrono::hours(24 * 365));
+  }
+
+  // Runs callback on the writer thread once ticket is on disk, or at once
+  // on the calling thread if it already is; committed is false if the
+  // logger failed first
+  void onCommit(uint64_t ticket, CommitCallback callback) {
+    bool committed;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      committed = committed_.load(std::memory_order_relaxed) >= ticket;
+      if (!committed && !failed_) {
+        callbacks_.emplace(ticket, std::move(callback));
+        return;
+      }
+    }
+    callback(ticket, committed);
+  }
+
+  // Commits everything appended so far, without waiting out maxDelay,
+  // before returning
+  void flush() {
+    uint64_t ticket;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ticket = appended_;
+      commit_requested_ = !buffer_.empty();
+    }
+    if (thread_ptr_) {
+      cond_.notify_one();
+      waitForCommit(ticket);
+    } else {
+      std::unique_lock<std::mutex> lock(mutex_);
+      commitGroup(lock);
+    }
+  }
+
+  // Routes Logger output (all of it, or one index) to this logger
+  void install(int index = -1) {
+    Logger::setOutputFunction(
+            [this](const char* msg, const uint64_t len) { append(msg, len); },
+            [this]() { flush(); }, index);
+  }
+
+  Stats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+ private:
+  struct LastTicket {
+    const GroupCommitLogger* owner_{ nullptr };
+    uint64_t ticket_{ 0 };
+  };
+
+  static LastTicket& lastTicketSlot() {
+    thread_local LastTicket last;
+    return last;
+  }
+
+  void threadFunc() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      cond_.wait(lock, [this]() { return !buffer_.empty() || !running_; });
+      if (buffer_.empty())
+        break;
+      // Let the group fill up until the delay expires or it is big enough
+      cond_.wait_until(lock, batch_start_ + max_delay_, [this]() {
+        return buffer_.size() >= max_bytes_ || commit_requested_ || !running_;
+      });
+      commitGroup(lock);
+    }
+  }
+
+  // Called with lock held; releases it around the write and the sync
+  void commitGroup(std::unique_lock<std::mutex>& lock) {
+    committed_cond_.wait(lock, [this]() { return !committing_; });
+    if (buffer_.empty())
+      return;
+    committing_ = true;
+    writing_.swap(buffer_);
+    uint64_t ticket{ appended_ };
+    uint64_t records{ ticket - committed_.load(std::memory_order_relaxed) };
+    commit_requested_ = false;
+    lock.unlock();
+
+    auto start{ std::chrono::steady_clock::now() };
+    struct iovec iov{ &writing_[0], writing_.size() };
+    uint64_t errors{ sink_->errors() };
+    sink_->write(&iov, 1);
+    sink_->flush();
+    bool ok{ sink_->errors() == errors && sink_->fd() >= 0 &&
+             ::fdatasync(sink_->fd()) == 0 };
+    int64_t nanos{ std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - start)
+                           .count() };
+    size_t bytes{ writing_.size() };
+    writing_.clear();
+
+    lock.lock();
+    committing_ = false;
+    std::vector<std::pair<uint64_t, CommitCallback>> ready;
+    ok = ok && !failed_;
+    if (ok) {
+      committed_.store(ticket, std::memory_order_release);
+      stats_.records_ += records;
+      stats_.bytes_ += bytes;
+      ++stats_.commits_;
+    } else {
+      failed_ = true;
+      ++stats_.errors_;
+    }
+    // A failure releases every callback, no later ticket can commit
+    auto end{ ok ? callbacks_.upper_bound(ticket) : callbacks_.end() };
+    for (auto it = callbacks_.begin(); it != end; ++it) {
+      ready.emplace_back(it->first, std::move(it->second));
+    }
+    callbacks_.erase(callbacks_.begin(), end);
+    stats_.sync_nanos_ += nanos;
+    stats_.max_sync_nanos_ = std::max(stats_.max_sync_nanos_, nanos);
+    committed_cond_.notify_all();
+    if (!ready.empty()) {
+      lock.unlock();
+      for (auto& entry : ready) {
+        entry.second(entry.first, ok);
+      }
+      lock.lock();
+    }
+  }
+
+  LogFileSinkPtr sink_;
+  std::chrono::microseconds max_delay_{ 1000 };
+  size_t max_bytes_{ 1024 * 1024 };
+
+  mutable std::mutex mutex_;
+  std::condition_variable cond_;
+  std::condition_variable committed_cond_;
+  std::string buffer_;
+  std::string writing_;
+  std::chrono::steady_clock::time_point batch_start_;
+  uint64_t appended_{ 0 };
+  std::atomic<uint64_t> committed_{ 0 };
+  std::multimap<uint64_t, CommitCallback> callbacks_;
+  bool commit_requested_{ false };
+  bool committing_{ false };
+  bool failed_{ false };
+  bool running_{ false };
+  Stats stats_{};
+  std::unique_ptr<std::thread> thread_ptr_;
+};
+
+}  // namespace hlp
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include "hlp/non_copyable.h"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace hlp {
+
+// A buffer handed out by LogBufferPool. data_ is aligned to kAlignment and
+// capacity_ is a multiple of it, so buffers can be written with O_DIRECT.
+struct LogBuffer {
+  char* data_{ nullptr };
+  size_t capacity_{ 0 };
+  uint32_t index_{ 0 };
+};
+
+// Fixed set of large, page-aligned log buffers carved out of one mapping
+// (backed by huge pages when the system has them). Buffers cycle between
+// producers and the writer through a lock-free free list, with no reference
+// counting and no reallocation; when every buffer is in use acquire()
+// returns nullptr and the exhaustion is counted.
+class LogBufferPool : public NonCopyable {
+ public:
+  static constexpr size_t kAlignment{ 4096 };
+  static constexpr size_t kHugePageSize{ 2 * 1024 * 1024 };
+
+  struct Stats {
+    size_t buffer_count_;
+    size_t buffer_size_;
+    bool huge_pages_;
+    size_t in_use_;
+    size_t high_water_;
+    uint64_t acquired_;
+    uint64_t exhausted_;
+  };
+
+  LogBufferPool(size_t buffer_count, size_t buffer_size)
+          : buffer_count_(buffer_count ? buffer_count : 1),
+            buffer_size_((std::max(buffer_size, kAlignment) + kAlignment - 1) /
+                         kAlignment * kAlignment),
+            buffers_(new LogBuffer[buffer_count_]),
+            next_free_(new std::atomic<uint32_t>[buffer_count_]) {
+    mapRegion();
+    for (size_t i = 0; i < buffer_count_; ++i) {
+      buffers_[i].data_ = region_ + i * buffer_size_;
+      buffers_[i].capacity_ = buffer_size_;
+      buffers_[i].index_ = static_cast<uint32_t>(i);
+      next_free_[i].store(
+              i + 1 < buffer_count_ ? static_cast<uint32_t>(i + 1) : kNil,
+              std::memory_order_relaxed);
+    }
+    free_head_.store(pack(0, 0), std::memory_order_relaxed);
+  }
+
+  ~LogBufferPool() {
+    unmapRegion();
+  }
+
+  LogBuffer* acquire() {
+    uint64_t head{ free_head_.load(std::memory_order_acquire) };
+    for (;;) {
+      uint32_t index{ indexOf(head) };
+      if (index == kNil) {
+        exhausted_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+      }
+      uint32_t next{ next_free_[index].load(std::memory_order_relaxed) };
+      if (free_head_.compare_exchange_weak(head, pack(next, tagOf(head) + 1),
+                                           std::memory_order_acq_rel,
+                                           std::memory_order_acquire)) {
+        acquired_.fetch_add(1, std::memory_order_relaxed);
+        size_t in_use{ in_use_.fetch_add(1, std::memory_order_relaxed) + 1 };
+        size_t high{ high_water_.load(std::memory_order_relaxed) };
+        while (in_use > high && !high_water_.compare_exchange_weak(
+                                        high, in_use,
+                                        std::memory_order_relaxed)) {
+        }
+        return &buffers_[index];
+      }
+    }
+  }
+
+  void release(LogBuffer* buf) {
+    uint64_t head{ free_head_.load(std::memory_order_relaxed) };
+    do {
+      next_free_[buf->index_].store(indexOf(head), std::memory_order_relaxed);
+    } while (!free_head_.compare_exchange_weak(
+            head, pack(buf->index_, tagOf(head) + 1), std::memory_order_release,
+            std::memory_order_relaxed));
+    in_use_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  size_t bufferCount() const {
+    return buffer_count_;
+  }
+
+  size_t bufferSize() const {
+    return buffer_size_;
+  }
+
+  size_t inUse() const {
+    return in_use_.load(std::memory_order_relaxed);
+  }
+
+  Stats stats() const {
+    return { buffer_count_,
+             buffer_size_,
+             huge_pages_,
+             in_use_.load(std::memory_order_relaxed),
+             high_water_.load(std::memory_order_relaxed),
+             acquired_.load(std::memory_order_relaxed),
+             exhausted_.load(std::memory_order_relaxed) };
+  }
+
+ private:
+  // The free list head packs an ABA tag with the buffer index
+  static constexpr uint32_t kNil{ UINT32_MAX };
+  static uint64_t pack(uint32_t index, uint32_t tag) {
+    return (static_cast<uint64_t>(tag) << 32) | index;
+  }
+  static uint32_t indexOf(uint64_t head) {
+    return static_cast<uint32_t>(head);
+  }
+  static uint32_t tagOf(uint64_t head) {
+    return static_cast<uint32_t>(head >> 32);
+  }
+
+  void mapRegion() {
+    region_size_ = buffer_count_ * buffer_size_;
+#if defined(__linux__)
+    size_t huge_size{ (region_size_ + kHugePageSize - 1) / kHugePageSize *
+                      kHugePageSize };
+    void* addr{ mmap(nullptr, huge_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0) };
+    if (addr != MAP_FAILED) {
+      huge_pages_ = true;
+      region_size_ = huge_size;
+    } else {
+      addr = mmap(nullptr, region_size_, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (addr == MAP_FAILED)
+        throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+      madvise(addr, region_size_, MADV_HUGEPAGE);
+#endif
+    }
+    region_ = static_cast<char*>(addr);
+#else
+    region_ = static_cast<char*>(
+            ::operator new(region_size_, std::align_val_t(kAlignment)));
+#endif
+  }
+
+  void unmapRegion() {
+#if defined(__linux__)
+    munmap(region_, region_size_);
+#else
+    ::operator delete(region_, std::align_val_t(kAlignment));
+#endif
+  }
+
+  const size_t buffer_count_;
+  const size_t buffer_size_;
+  std::unique_ptr<LogBuffer[]> buffers_;
+  std::unique_ptr<std::atomic<uint32_t>[]> next_free_;
+  char* region_{ nullptr };
+  size_t region_size_{ 0 };
+  bool huge_pages_{ false };
+
+  alignas(64) std::atomic<uint64_t> free_head_{ 0 };
+  alignas(64) std::atomic<size_t> in_use_{ 0 };
+  std::atomic<size_t> high_water_{ 0 };
+  std::atomic<uint64_t> acquired_{ 0 };
+  std::atomic<uint64_t> exhausted_{ 0 };
+};
+
+}  // namespace hlp
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "logger.h"
+
+namespace hlp {
+
+// A named log level that can be changed at runtime independently of
+// Logger::logLevel(). Categories are constant-initialized, so the LOG_*_CAT
+// macros test one relaxed load of a link-time address plus a branch, and
+// they are usable even before their registration has run.
+class LogCategory : public NonCopyable {
+ public:
+  constexpr explicit LogCategory(const char* name) : name_(name) {
+  }
+
+  bool enabled(Logger::LogLevel level) const {
+    return level_.load(std::memory_order_relaxed) <= level;
+  }
+
+  Logger::LogLevel level() const {
+    return static_cast<Logger::LogLevel>(
+            level_.load(std::memory_order_relaxed));
+  }
+
+  void setLevel(Logger::LogLevel level) {
+    level_.store(level, std::memory_order_relaxed);
+  }
+
+  // Name with any directory part of a __FILE__ name removed
+  std::string_view name() const {
+    const char* slash{ strrchr(name_, '/') };
+    return slash ? slash + 1 : name_;
+  }
+
+ private:
+  const char* name_;
+#ifdef RELEASE
+  std::atomic<int> level_{ Logger::LogLevel::INFO };
+#else
+  std::atomic<int> level_{ Logger::LogLevel::DEBUG };
+#endif
+};
+
+// Finds categories by name. A level set for a name (or "*" for all) also
+// applies to categories registered later, e.g. from a shared library.
+class LogCategoryRegistry : public NonCopyable {
+ public:
+  static LogCategoryRegistry& instance() {
+    static LogCategoryRegistry registry;
+    return registry;
+  }
+
+  void add(LogCategory& category) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    categories_.push_back(&category);
+    auto it{ levels_.find(std::string(category.name())) };
+    if (it != levels_.end()) {
+      category.setLevel(it->second);
+    } else if (has_default_) {
+      category.setLevel(default_level_);
+    }
+  }
+
+  void remove(LogCategory& category) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    categories_.erase(
+            std::remove(categories_.begin(), categories_.end(), &category),
+            categories_.end());
+  }
+
+  // Returns the number of registered categories that matched
+  size_t setLevel(std::string_view name, Logger::LogLevel level) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (name == "*") {
+      levels_.clear();
+      has_default_ = true;
+      default_level_ = level;
+    } else {
+      levels_[std::string(name)] = level;
+    }
+    size_t matched{ 0 };
+    for (auto category : categories_) {
+      if (name == "*" || category->name() == name) {
+        category->setLevel(level);
+        ++matched;
+      }
+    }
+    return matched;
+  }
+
+  std::vector<std::pair<std::string, Logger::LogLevel>> levels() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::pair<std::string, Logger::LogLevel>> result;
+    for (auto category : categories_) {
+      result.emplace_back(std::string(category->name()), category->level());
+    }
+    return result;
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::vector<LogCategory*> categories_;
+  std::unordered_map<std::string, Logger::LogLevel> levels_;
+  bool has_default_{ false };
+  Logger::LogLevel default_level_{ Logger::LogLevel::INFO };
+};
+
+class LogCategoryRegistrar : public NonCopyable {
+ public:
+  explicit LogCategoryRegistrar(LogCategory& category) : category_(category) {
+    LogCategoryRegistry::instance().add(category_);
+  }
+  ~LogCategoryRegistrar() {
+    LogCategoryRegistry::instance().remove(category_);
+  }
+
+ private:
+  LogCategory& category_;
+};
+
+}  // namespace hlp
+
+// HLP_DEFINE_LOG_CATEGORY(kNetLog, "net") at namespace scope, in a header
+// or a source file; then LOG_DEBUG_CAT(kNetLog) << ...
+#define HLP_DEFINE_LOG_CATEGORY(var, name)                                     \
+  inline hlp::LogCategory var{ name };                                         \
+  inline const hlp::LogCategoryRegistrar var##Registrar_{ var }
+
+// Category named after the current source file, for LOG_*_FILE
+#define HLP_DEFINE_FILE_LOG_CATEGORY()                                         \
+  namespace {                                                                  \
+  hlp::LogCategory hlpFileLogCategory_{ __FILE__ };                            \
+  const hlp::LogCategoryRegistrar hlpFileLogCategoryRegistrar_{               \
+    hlpFileLogCategory_                                                        \
+  };                                                                           \
+  }
+
+#define LOG_TRACE_CAT(category)                                                \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::TRACE)                                \
+  LOGGER_IF_((category).enabled(hlp::Logger::LogLevel::TRACE))                 \
+  hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::TRACE, __func__)      \
+          .stream()
+#define LOG_DEBUG_CAT(category)                                                \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::DEBUG)                                \
+  LOGGER_IF_((category).enabled(hlp::Logger::LogLevel::DEBUG))                 \
+  hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::DEBUG, __func__)      \
+          .stream()
+#define LOG_INFO_CAT(category)                                                 \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::INFO)                                 \
+  LOGGER_IF_((category).enabled(hlp::Logger::LogLevel::INFO))                  \
+  hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::INFO).stream()
+#define LOG_WARN_CAT(category)                                                 \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::WARN)                                 \
+  LOGGER_IF_((category).enabled(hlp::Logger::LogLevel::WARN))                  \
+  hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::WARN).stream()
+#define LOG_ERROR_CAT(category)                                                \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::ERROR)                                \
+  LOGGER_IF_((category).enabled(hlp::Logger::LogLevel::ERROR))                 \
+  hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::ERROR).stream()
+#define LOG_FATAL_CAT(category)                                                \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::FATAL)                                \
+  LOGGER_IF_((category).enabled(hlp::Logger::LogLevel::FATAL))                 \
+  hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::FATAL).stream()
+
+#define LOG_TRACE_FILE LOG_TRACE_CAT(hlpFileLogCategory_)
+#define LOG_DEBUG_FILE LOG_DEBUG_CAT(hlpFileLogCategory_)
+#define LOG_INFO_FILE LOG_INFO_CAT(hlpFileLogCategory_)
+#define LOG_WARN_FILE LOG_WARN_CAT(hlpFileLogCategory_)
+#define LOG_ERROR_FILE LOG_ERROR_CAT(hlpFileLogCategory_)
+#define LOG_FATAL_FILE LOG_FATAL_CAT(hlpFileLogCategory_)
@@ -0,0 +1,516 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include "log_file_sink.h"
+
+#if __has_include(<zstd.h>)
+#include <zstd.h>
+#define HLP_LOG_HAS_ZSTD 1
+#endif
+#if __has_include(<lz4frame.h>)
+#include <lz4frame.h>
+#define HLP_LOG_HAS_LZ4 1
+#endif
+#if __has_include(<zlib.h>)
+#include <zlib.h>
+#define HLP_LOG_HAS_ZLIB 1
+#endif
+
+namespace hlp {
+
+// Streaming compressor producing a self-contained file format. Each call
+// appends its output to out; flush() makes everything given so far
+// decodable and finish() ends the stream.
+class LogCompressor : public NonCopyable {
+ public:
+  virtual ~LogCompressor() = default;
+  // File name suffix of the format, e.g. ".zst"
+  virtual const char* extension() const = 0;
+  virtual bool compress(const char* data, size_t len, std::string& out) = 0;
+  virtual bool flush(std::string& out) = 0;
+  virtual bool finish(std::string& out) = 0;
+};
+using LogCompressorPtr = std::unique_ptr<LogCompressor>;
+using LogCompressorFactory = std::function<LogCompressorPtr()>;
+
+#ifdef HLP_LOG_HAS_ZSTD
+class ZstdCompressor : public LogCompressor {
+ public:
+  explicit ZstdCompressor(int level = 3) : ctx_(ZSTD_createCCtx()) {
+    ZSTD_CCtx_setParameter(ctx_, ZSTD_c_compressionLevel, level);
+  }
+  ~ZstdCompressor() override {
+    ZSTD_freeCCtx(ctx_);
+  }
+
+  const char* extension() const override {
+    return ".zst";
+  }
+  bool compress(const char* data, size_t len, std::string& out) override {
+    return run(data, len, ZSTD_e_continue, out);
+  }
+  bool flush(std::string& out) override {
+    return run(nullptr, 0, ZSTD_e_flush, out);
+  }
+  bool finish(std::string& out) override {
+    return run(nullptr, 0, ZSTD_e_end, out);
+  }
+
+ private:
+  bool run(const char* data, size_t len, ZSTD_EndDirective mode,
+           std::string& out) {
+    ZSTD_inBuffer in{ data, len, 0 };
+    for (;;) {
+      size_t old_size{ out.size() };
+      out.resize(old_size + ZSTD_CStreamOutSize());
+      ZSTD_outBuffer output{ &out[old_size], out.size() - old_size, 0 };
+      size_t left{ ZSTD_compressStream2(ctx_, &output, &in, mode) };
+      out.resize(old_size + output.pos);
+      if (ZSTD_isError(left))
+        return false;
+      if (mode == ZSTD_e_continue ? in.pos == in.size : left == 0)
+        return true;
+    }
+  }
+
+  ZSTD_CCtx* ctx_;
+};
+#endif
+
+#ifdef HLP_LOG_HAS_LZ4
+class Lz4Compressor : public LogCompressor {
+ public:
+  explicit Lz4Compressor(int level = 0) {
+    LZ4F_createCompressionContext(&ctx_, LZ4F_VERSION);
+    prefs_.compressionLevel = level;
+    prefs_.frameInfo.blockMode = LZ4F_blockLinked;
+  }
+  ~Lz4Compressor() override {
+    LZ4F_freeCompressionContext(ctx_);
+  }
+
+  const char* extension() const override {
+    return ".lz4";
+  }
+  bool compress(const char* data, size_t len, std::string& out) override {
+    if (!begin(out))
+      return false;
+    char* dst{ grow(out, LZ4F_compressBound(len, &prefs_)) };
+    return commit(out, dst,
+                  LZ4F_compressUpdate(ctx_, dst, out.size() - (dst - &out[0]),
+                                      data, len, nullptr));
+  }
+  bool flush(std::string& out) override {
+    if (!begin(out))
+      return false;
+    char* dst{ grow(out, LZ4F_compressBound(0, &prefs_)) };
+    return commit(out, dst,
+                  LZ4F_flush(ctx_, dst, out.size() - (dst - &out[0]), nullptr));
+  }
+  bool finish(std::string& out) override {
+    if (!begin(out))
+      return false;
+    char* dst{ grow(out, LZ4F_compressBound(0, &prefs_)) };
+    started_ = false;
+    return commit(out, dst,
+                  LZ4F_compressEnd(ctx_, dst, out.size() - (dst - &out[0]),
+                                   nullptr));
+  }
+
+ private:
+  bool begin(std::string& out) {
+    if (started_)
+      return true;
+    started_ = true;
+    char* dst{ grow(out, LZ4F_HEADER_SIZE_MAX) };
+    return commit(out, dst,
+                  LZ4F_compressBegin(ctx_, dst, LZ4F_HEADER_SIZE_MAX, &prefs_));
+  }
+
+  static char* grow(std::string& out, size_t len) {
+    size_t old_size{ out.size() };
+    out.resize(old_size + len);
+    return &out[old_size];
+  }
+
+  // Trims out to the len bytes produced at dst
+  static bool commit(std::string& out, char* dst, size_t len) {
+    if (LZ4F_isError(len)) {
+      out.resize(static_cast<size_t>(dst - &out[0]));
+      return false;
+    }
+    out.resize(static_cast<size_t>(dst - &out[0]) + len);
+    return true;
+  }
+
+  LZ4F_cctx* ctx_{ nullptr };
+  LZ4F_preferences_t prefs_{};
+  bool started_{ false };
+};
+#endif
+
+#ifdef HLP_LOG_HAS_ZLIB
+class GzipCompressor : public LogCompressor {
+ public:
+  explicit GzipCompressor(int level = 1) {
+    // 15 + 16: largest window with a gzip header and trailer
+    deflateInit2(&stream_, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+  }
+  ~GzipCompressor() override {
+    deflateEnd(&stream_);
+  }
+
+  const char* extension() const override {
+    return ".gz";
+  }
+  bool compress(const char* data, size_t len, std::string& out) override {
+    return run(data, len, Z_NO_FLUSH, out);
+  }
+  bool flush(std::string& out) override {
+    return run(nullptr, 0, Z_SYNC_FLUSH, out);
+  }
+  bool finish(std::string& out) override {
+    bool ok{ run(nullptr, 0, Z_FINISH, out) };
+    deflateReset(&stream_);
+    return ok;
+  }
+
+ private:
+  bool run(const char* data, size_t len, int mode, std::string& out) {
+    stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream_.avail_in = static_cast<uInt>(len);
+    for (;;) {
+      size_t old_size{ out.size() };
+      size_t room{ std::max<size_t>(deflateBound(&stream_, len), 4096) };
+      out.resize(old_size + room);
+      stream_.next_out = reinterpret_cast<Bytef*>(&out[old_size]);
+      stream_.avail_out = static_cast<uInt>(room);
+      int ret{ deflate(&stream_, mode) };
+      out.resize(old_size + room - stream_.avail_out);
+      if (ret == Z_STREAM_ERROR)
+        return false;
+      if (mode == Z_FINISH ? ret == Z_STREAM_END
+                           : stream_.avail_out != 0 && stream_.avail_in == 0)
+        return true;
+    }
+  }
+
+  z_stream stream_{};
+};
+#endif
+
+// Best codec this build has: zstd, then lz4, then gzip; nullptr if none
+inline LogCompressorFactory defaultCompressorFactory() {
+#if defined(HLP_LOG_HAS_ZSTD)
+  return []() -> LogCompressorPtr { return std::make_unique<ZstdCompressor>(); };
+#elif defined(HLP_LOG_HAS_LZ4)
+  return []() -> LogCompressorPtr { return std::make_unique<Lz4Compressor>(); };
+#elif defined(HLP_LOG_HAS_ZLIB)
+  return []() -> LogCompressorPtr { return std::make_unique<GzipCompressor>(); };
+#else
+  return nullptr;
+#endif
+}
+
+// Counters shared by CompressedFileSink and ArchiveCompressor; readable
+// from any thread
+class CompressionStats {
+ public:
+  void add(uint64_t input_bytes, uint64_t output_bytes, int64_t nanos) {
+    input_bytes_.fetch_add(input_bytes, std::memory_order_relaxed);
+    output_bytes_.fetch_add(output_bytes, std::memory_order_relaxed);
+    nanos_.fetch_add(nanos, std::memory_order_relaxed);
+  }
+  void addError() {
+    errors_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  uint64_t inputBytes() const {
+    return input_bytes_.load(std::memory_order_relaxed);
+  }
+  uint64_t outputBytes() const {
+    return output_bytes_.load(std::memory_order_relaxed);
+  }
+  // Input bytes per output byte
+  double ratio() const {
+    uint64_t output{ outputBytes() };
+    return output == 0 ? 0 : static_cast<double>(inputBytes()) / output;
+  }
+  // Input megabytes (1e6) compressed per second of compressor time
+  double throughputMBps() const {
+    int64_t nanos{ nanos_.load(std::memory_order_relaxed) };
+    return nanos == 0 ? 0 : inputBytes() * 1e3 / static_cast<double>(nanos);
+  }
+  // Codec failures; CompressedFileSink drops the chunk that failed
+  uint64_t errors() const {
+    return errors_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<uint64_t> input_bytes_{ 0 };
+  std::atomic<uint64_t> output_bytes_{ 0 };
+  std::atomic<int64_t> nanos_{ 0 };
+  std::atomic<uint64_t> errors_{ 0 };
+};
+
+namespace detail {
+inline int64_t compressionClock() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 std::chrono::steady_clock::now().time_since_epoch())
+          .count();
+}
+}  // namespace detail
+
+// Compresses each batch on the writer thread before handing it to another
+// sink. length() is the compressed size, so a RollingFileSink built on it
+// rotates on compressed bytes; give the files the codec's extension, e.g.
+// setFilename("app", ".log.zst"). flush() ends a codec block so the file
+// stays readable up to the last flush if the process dies.
+class CompressedFileSink : public LogFileSink {
+ public:
+  explicit CompressedFileSink(
+          LogFileSinkPtr sink = std::make_shared<PwritevFileSink>(),
+          LogCompressorFactory factory = defaultCompressorFactory())
+          : sink_(std::move(sink)), factory_(std::move(factory)) {
+  }
+  ~CompressedFileSink() override {
+    close();
+  }
+
+  bool open(const std::string& fullname) override {
+    close();
+    if (!factory_ || !sink_->open(fullname))
+      return false;
+    compressor_ = factory_();
+    return compressor_ != nullptr;
+  }
+
+  void close() override {
+    if (compressor_) {
+      int64_t start{ detail::compressionClock() };
+      compressor_->finish(out_);
+      emit(0, start);
+      compressor_.reset();
+    }
+    sink_->close();
+  }
+
+  void write(const struct iovec* iov, int count) override {
+    if (!compressor_)
+      return;
+    int64_t start{ detail::compressionClock() };
+    uint64_t input_bytes{ 0 };
+    for (int i = 0; i < count && compressor_; ++i) {
+      size_t mark{ out_.size() };
+      if (compressor_->compress(static_cast<const char*>(iov[i].iov_base),
+                                iov[i].iov_len, out_)) {
+        input_bytes += iov[i].iov_len;
+        continue;
+      }
+      // The chunk is dropped. The stream is ended where the previous chunk
+      // left it, if the codec still can, and a new one carries on.
+      stats_.addError();
+      ++errors_;
+      out_.resize(mark);
+      if (!compressor_->finish(out_))
+        out_.resize(mark);
+      compressor_ = factory_();
+    }
+    emit(input_bytes, start);
+  }
+
+  void flush() override {
+    if (compressor_) {
+      int64_t start{ detail::compressionClock() };
+      compressor_->flush(out_);
+      emit(0, start);
+    }
+    sink_->flush();
+  }
+
+  uint64_t length() const override {
+    return sink_->length();
+  }
+
+  int fd() const override {
+    return sink_->fd();
+  }
+
+  void preallocate(uint64_t size) override {
+    sink_->preallocate(size);
+  }
+
+  size_t rotations() const override {
+    return sink_->rotations();
+  }
+
+  // Dropped chunks count as well as the wrapped sink's failures
+  uint64_t errors() const override {
+    return errors_ + sink_->errors();
+  }
+
+  const CompressionStats& stats() const {
+    return stats_;
+  }
+
+ private:
+  void emit(uint64_t input_bytes, int64_t start) {
+    stats_.add(input_bytes, out_.size(), detail::compressionClock() - start);
+    if (!out_.empty()) {
+      struct iovec iov{ &out_[0], out_.size() };
+      sink_->write(&iov, 1);
+      out_.clear();
+    }
+  }
+
+  LogFileSinkPtr sink_;
+  LogCompressorFactory factory_;
+  LogCompressorPtr compressor_;
+  std::string out_;
+  CompressionStats stats_;
+};
+
+// Background thread compressing finished files: <path> becomes
+// <path><extension> and the original is removed once the copy is complete.
+// Files are done in submission order, one at a time.
+class ArchiveCompressor : public NonCopyable {
+ public:
+  static constexpr size_t kChunkSize{ 1024 * 1024 };
+
+  explicit ArchiveCompressor(
+          LogCompressorFactory factory = defaultCompressorFactory())
+          : factory_(std::move(factory)),
+            extension_(factory_ ? factory_()->extension() : ""),
+            thread_([this]() { threadFunc(); }) {
+  }
+  ~ArchiveCompressor() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      running_ = false;
+    }
+    cond_.notify_all();
+    thread_.join();
+  }
+
+  const std::string& extension() const {
+    return extension_;
+  }
+
+  void submit(const std::string& path) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push_back(path);
+    }
+    cond_.notify_all();
+  }
+
+  // Blocks until every submitted file has been handled
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_cond_.wait(lock, [this]() { return queue_.empty() && !busy_; });
+  }
+
+  const CompressionStats& stats() const {
+    return stats_;
+  }
+
+  uint64_t filesCompressed() const {
+    return files_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  void threadFunc() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      cond_.wait(lock, [this]() { return !queue_.empty() || !running_; });
+      if (queue_.empty())
+        return;
+      std::string path{ std::move(queue_.front()) };
+      queue_.pop_front();
+      busy_ = true;
+      lock.unlock();
+      if (compressFile(path))
+        files_.fetch_add(1, std::memory_order_relaxed);
+      lock.lock();
+      busy_ = false;
+      if (queue_.empty())
+        idle_cond_.notify_all();
+    }
+  }
+
+  bool compressFile(const std::string& path) {
+    if (!factory_)
+      return false;
+    int in{ ::open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+    if (in < 0)
+      return false;
+    std::string target{ path + extension_ };
+    int out{ ::open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0644) };
+    if (out < 0) {
+      ::close(in);
+      return false;
+    }
+    auto compressor{ factory_() };
+    std::unique_ptr<char[]> chunk{ new char[kChunkSize] };
+    std::string output;
+    uint64_t offset{ 0 };
+    bool ok{ true };
+    for (;;) {
+      ssize_t n{ ::read(in, chunk.get(), kChunkSize) };
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0) {
+        ok = false;
+        break;
+      }
+      int64_t start{ detail::compressionClock() };
+      ok = n > 0 ? compressor->compress(chunk.get(), static_cast<size_t>(n),
+                                        output)
+                 : compressor->finish(output);
+      if (!ok)
+        stats_.addError();
+      stats_.add(static_cast<uint64_t>(n), output.size(),
+                 detail::compressionClock() - start);
+      ok = ok && internal::pwriteAll(out, output.data(), output.size(), offset);
+      offset += output.size();
+      output.clear();
+      if (!ok || n == 0)
+        break;
+    }
+    ::close(in);
+    ::close(out);
+    // A source removed meanwhile (max_files pruning) takes its copy with it
+    if (!ok || ::unlink(path.c_str()) != 0) {
+      ::unlink(target.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  LogCompressorFactory factory_;
+  std::string extension_;
+  CompressionStats stats_;
+  std::atomic<uint64_t> files_{ 0 };
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::condition_variable idle_cond_;
+  std::deque<std::string> queue_;
+  bool running_{ true };
+  bool busy_{ false };
+  std::thread thread_;
+};
+
+}  // namespace hlp
@@ -0,0 +1,711 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "hlp/non_copyable.h"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/xattr.h>
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HLP_LOG_HAS_IO_URING 1
+#endif
+#endif
+
+namespace hlp {
+
+// Destination file of a log writer thread. Unlike AsyncFileLogger's
+// LoggerFile, which goes through a stdio FILE*, a sink receives a whole
+// harvested batch as an iovec array and decides how it reaches the disk.
+// Sinks are used from one writer thread at a time.
+class LogFileSink : public NonCopyable {
+ public:
+  virtual ~LogFileSink() = default;
+
+  virtual bool open(const std::string& fullname) = 0;
+  virtual void close() = 0;
+  // The iovec data only has to stay valid until write() returns
+  virtual void write(const struct iovec* iov, int count) = 0;
+  // Pushes everything written so far to the kernel
+  virtual void flush() = 0;
+  // Logical file length in bytes
+  virtual uint64_t length() const = 0;
+  virtual int fd() const = 0;
+  // Hint that the open file will grow to about size bytes
+  virtual void preallocate(uint64_t size) {
+    (void)size;
+  }
+  // Files started after the first one, for sinks that rotate
+  virtual size_t rotations() const {
+    return 0;
+  }
+  // Writes or flushes that lost data since the sink was created; never
+  // decreases, so a caller compares it before and after a write
+  virtual uint64_t errors() const {
+    return errors_;
+  }
+
+  explicit operator bool() const {
+    return fd() >= 0;
+  }
+
+ protected:
+  uint64_t errors_{ 0 };
+};
+using LogFileSinkPtr = std::shared_ptr<LogFileSink>;
+
+namespace internal {
+inline size_t iovecLength(const struct iovec* iov, int count) {
+  size_t total{ 0 };
+  for (int i = 0; i < count; ++i) {
+    total += iov[i].iov_len;
+  }
+  return total;
+}
+
+// pwrite()s the whole buffer, retrying short writes and EINTR
+inline bool pwriteAll(int fd, const char* data, size_t len, uint64_t offset) {
+  while (len > 0) {
+    ssize_t n{ ::pwrite(fd, data, len, static_cast<off_t>(offset)) };
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      std::cerr << "log write failed: " << strerror(errno) << "\n";
+      return false;
+    }
+    data += n;
+    len -= static_cast<size_t>(n);
+    offset += static_cast<uint64_t>(n);
+  }
+  return true;
+}
+}  // namespace internal
+
+// Batch writer: one pwritev(2) per IOV_MAX chunks, no user-space copy
+class PwritevFileSink : public LogFileSink {
+ public:
+  ~PwritevFileSink() override {
+    close();
+  }
+
+  bool open(const std::string& fullname) override {
+    close();
+    fd_ = ::open(fullname.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+      std::cerr << "Can't open " << fullname << ": " << strerror(errno)
+                << "\n";
+      return false;
+    }
+    struct stat st;
+    offset_ = fstat(fd_, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+    return true;
+  }
+
+  void close() override {
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  void write(const struct iovec* iov, int count) override {
+    if (fd_ < 0)
+      return;
+    iov_.assign(iov, iov + count);
+    size_t pos{ 0 };
+    while (pos < iov_.size()) {
+      auto batch{ static_cast<int>(
+              std::min<size_t>(iov_.size() - pos, IOV_MAX)) };
+      ssize_t n{ ::pwritev(fd_, &iov_[pos], batch,
+                           static_cast<off_t>(offset_)) };
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        std::cerr << "log write failed: " << strerror(errno) << "\n";
+        ++errors_;
+        return;
+      }
+      offset_ += static_cast<uint64_t>(n);
+      // Skip fully written entries and trim a partially written one
+      auto left{ static_cast<size_t>(n) };
+      while (pos < iov_.size() && left >= iov_[pos].iov_len) {
+        left -= iov_[pos].iov_len;
+        ++pos;
+      }
+      if (left > 0) {
+        iov_[pos].iov_base = static_cast<char*>(iov_[pos].iov_base) + left;
+        iov_[pos].iov_len -= left;
+      }
+    }
+  }
+
+  void flush() override {
+  }
+
+  uint64_t length() const override {
+    return offset_;
+  }
+
+  int fd() const override {
+    return fd_;
+  }
+
+ protected:
+  int fd_{ -1 };
+  uint64_t offset_{ 0 };
+  std::vector<struct iovec> iov_;
+};
+
+// O_DIRECT writer: batches are copied into one aligned staging buffer and
+// written in whole blocks, bypassing the page cache. flush() writes the
+// partial tail block padded and trims the file back to its logical length;
+// the tail stays buffered and is rewritten once the block fills up.
+class DirectFileSink : public LogFileSink {
+ public:
+  static constexpr size_t kBlockSize{ 4096 };
+
+  explicit DirectFileSink(size_t buffer_size = 1024 * 1024)
+          : capacity_((std::max(buffer_size, kBlockSize) + kBlockSize - 1) /
+                      kBlockSize * kBlockSize),
+            buffer_(static_cast<char*>(
+                    ::operator new(capacity_, std::align_val_t(kBlockSize)))) {
+  }
+  ~DirectFileSink() override {
+    close();
+    ::operator delete(buffer_, std::align_val_t(kBlockSize));
+  }
+
+  bool open(const std::string& fullname) override {
+    close();
+    int flags{ O_WRONLY | O_CREAT | O_CLOEXEC };
+#ifdef O_DIRECT
+    flags |= O_DIRECT;
+#endif
+    fd_ = ::open(fullname.c_str(), flags, 0644);
+    if (fd_ < 0 && errno == EINVAL) {
+      // The filesystem does not support O_DIRECT (tmpfs for instance)
+      fd_ = ::open(fullname.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    }
+    if (fd_ < 0) {
+      std::cerr << "Can't open " << fullname << ": " << strerror(errno)
+                << "\n";
+      return false;
+    }
+    // Resume at the last whole block; its tail is read back into the buffer
+    struct stat st;
+    uint64_t size{ fstat(fd_, &st) == 0 ? static_cast<uint64_t>(st.st_size)
+                                        : 0 };
+    offset_ = size / kBlockSize * kBlockSize;
+    fill_ = static_cast<size_t>(size - offset_);
+    if (fill_ > 0) {
+      int reader{ ::open(fullname.c_str(), O_RDONLY | O_CLOEXEC) };
+      if (reader < 0 ||
+          ::pread(reader, buffer_, fill_, static_cast<off_t>(offset_)) !=
+                  static_cast<ssize_t>(fill_)) {
+        fill_ = 0;
+        offset_ = size;
+      }
+      if (reader >= 0)
+        ::close(reader);
+    }
+    return true;
+  }
+
+  void close() override {
+    if (fd_ >= 0) {
+      flush();
+      ::close(fd_);
+      fd_ = -1;
+    }
+    fill_ = 0;
+    flushed_fill_ = 0;
+    offset_ = 0;
+  }
+
+  void write(const struct iovec* iov, int count) override {
+    if (fd_ < 0)
+      return;
+    for (int i = 0; i < count; ++i) {
+      auto data{ static_cast<const char*>(iov[i].iov_base) };
+      size_t len{ iov[i].iov_len };
+      while (len > 0) {
+        size_t n{ std::min(len, capacity_ - fill_) };
+        memcpy(buffer_ + fill_, data, n);
+        fill_ += n;
+        data += n;
+        len -= n;
+        if (fill_ == capacity_)
+          writeFull();
+      }
+    }
+  }
+
+  void flush() override {
+    if (fd_ < 0 || fill_ == 0 || fill_ == flushed_fill_)
+      return;
+    size_t padded{ (fill_ + kBlockSize - 1) / kBlockSize * kBlockSize };
+    memset(buffer_ + fill_, 0, padded - fill_);
+    if (internal::pwriteAll(fd_, buffer_, padded, offset_)) {
+      if (::ftruncate(fd_, static_cast<off_t>(offset_ + fill_)) != 0) {
+        std::cerr << "log truncate failed: " << strerror(errno) << "\n";
+      }
+      flushed_fill_ = fill_;
+    } else {
+      ++errors_;
+    }
+  }
+
+  uint64_t length() const override {
+    return offset_ + fill_;
+  }
+
+  int fd() const override {
+    return fd_;
+  }
+
+ protected:
+  // Writes the whole blocks of the buffer and keeps the partial tail
+  void writeFull() {
+    size_t whole{ fill_ / kBlockSize * kBlockSize };
+    if (whole == 0)
+      return;
+    if (!internal::pwriteAll(fd_, buffer_, whole, offset_))
+      ++errors_;
+    offset_ += whole;
+    fill_ -= whole;
+    memmove(buffer_, buffer_ + whole, fill_);
+    flushed_fill_ = 0;
+  }
+
+  const size_t capacity_;
+  char* buffer_;
+  int fd_{ -1 };
+  uint64_t offset_{ 0 };
+  size_t fill_{ 0 };
+  size_t flushed_fill_{ 0 };
+};
+
+#if defined(__linux__)
+// Memory-mapped writer for preallocated files: open() + preallocate() reserve
+// the blocks up front with fallocate, writes are memcpys into a fixed-size
+// mapped window that slides forward when it fills, and length() is a plain
+// counter. close() trims the file back to its logical length. While the
+// file is open that length is kept in the user.hlp.length extended
+// attribute, updated after each write(), so open() resumes a file a crashed
+// process left preallocated right after its last batch; close() removes the
+// attribute. On a filesystem without user xattrs a crashed run's
+// zero-filled tail stays in place and the next run appends after it. The
+// mapping is never extended over blocks fallocate could not reserve (a
+// store there raises SIGBUS on a full disk): writes fall back to pwrite(2)
+// instead.
+class MmapFileSink : public LogFileSink {
+ public:
+  explicit MmapFileSink(size_t window_size = 16 * 1024 * 1024)
+          : window_size_(std::max<size_t>(window_size, kPageSize) /
+                         kPageSize * kPageSize) {
+  }
+  ~MmapFileSink() override {
+    close();
+  }
+
+  bool open(const std::string& fullname) override {
+    close();
+    fd_ = ::open(fullname.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+      std::cerr << "Can't open " << fullname << ": " << strerror(errno)
+                << "\n";
+      return false;
+    }
+    struct stat st;
+    length_ = fstat(fd_, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+    uint64_t recorded;
+    if (::fgetxattr(fd_, kLengthAttribute, &recorded, sizeof(recorded)) ==
+        static_cast<ssize_t>(sizeof(recorded))) {
+      length_ = std::min(length_, recorded);
+    }
+    allocated_ = length_;
+    track_length_ = true;
+    recorded_length_ = UINT64_MAX;
+    recordLength();
+    mapWindow(length_ / kPageSize * kPageSize);
+    return true;
+  }
+
+  void close() override {
+    if (fd_ < 0)
+      return;
+    unmapWindow();
+    if (::ftruncate(fd_, static_cast<off_t>(length_)) != 0) {
+      std::cerr << "log truncate failed: " << strerror(errno) << "\n";
+    } else if (track_length_) {
+      ::fremovexattr(fd_, kLengthAttribute);
+    }
+    ::close(fd_);
+    fd_ = -1;
+    length_ = allocated_ = 0;
+  }
+
+  void preallocate(uint64_t size) override {
+    if (fd_ >= 0 && size > allocated_)
+      allocate(size);
+  }
+
+  void write(const struct iovec* iov, int count) override {
+    if (fd_ < 0)
+      return;
+    for (int i = 0; i < count; ++i) {
+      auto data{ static_cast<const char*>(iov[i].iov_base) };
+      size_t len{ iov[i].iov_len };
+      while (len > 0) {
+        if (!window_) {
+          if (internal::pwriteAll(fd_, data, len, length_))
+            length_ += len;
+          else
+            ++errors_;
+          break;
+        }
+        uint64_t window_end{ window_offset_ + window_size_ };
+        if (length_ == window_end && !mapWindow(window_end))
+          continue;
+        size_t n{ std::min<size_t>(len, window_end - length_) };
+        memcpy(window_ + (length_ - window_offset_), data, n);
+        length_ += n;
+        data += n;
+        len -= n;
+      }
+    }
+    recordLength();
+  }
+
+  void flush() override {
+  }
+
+  uint64_t length() const override {
+    return length_;
+  }
+
+  int fd() const override {
+    return fd_;
+  }
+
+ protected:
+  static constexpr size_t kPageSize{ 4096 };
+  static constexpr const char* kLengthAttribute{ "user.hlp.length" };
+
+  bool allocate(uint64_t size) {
+    size = (size + kPageSize - 1) / kPageSize * kPageSize;
+    int err{ ::posix_fallocate(fd_, static_cast<off_t>(allocated_),
+                               static_cast<off_t>(size - allocated_)) };
+    if (err != 0) {
+      std::cerr << "log preallocation failed: " << strerror(err) << "\n";
+      return false;
+    }
+    allocated_ = size;
+    return true;
+  }
+
+  // Stores length_ in the file's attribute, given up on the first failure
+  void recordLength() {
+    if (!track_length_ || recorded_length_ == length_)
+      return;
+    if (::fsetxattr(fd_, kLengthAttribute, &length_, sizeof(length_), 0)) {
+      std::cerr << "log length not recorded: " << strerror(errno) << "\n";
+      track_length_ = false;
+      return;
+    }
+    recorded_length_ = length_;
+  }
+
+  // Maps [offset, offset + window_size_), growing the file when needed
+  bool mapWindow(uint64_t offset) {
+    unmapWindow();
+    uint64_t end{ offset + window_size_ };
+    if (end > allocated_ && !allocate(std::max(end, allocated_ * 2)))
+      return false;
+    void* addr{ ::mmap(nullptr, window_size_, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd_, static_cast<off_t>(offset)) };
+    if (addr == MAP_FAILED) {
+      std::cerr << "log mmap failed: " << strerror(errno) << "\n";
+      return false;
+    }
+    ::madvise(addr, window_size_, MADV_SEQUENTIAL);
+    window_ = static_cast<char*>(addr);
+    window_offset_ = offset;
+    return true;
+  }
+
+  void unmapWindow() {
+    if (window_) {
+      ::munmap(window_, window_size_);
+      window_ = nullptr;
+    }
+  }
+
+  const size_t window_size_;
+  int fd_{ -1 };
+  char* window_{ nullptr };
+  uint64_t window_offset_{ 0 };
+  uint64_t length_{ 0 };
+  uint64_t allocated_{ 0 };
+  uint64_t recorded_length_{ UINT64_MAX };
+  bool track_length_{ false };
+};
+#endif
+
+#ifdef HLP_LOG_HAS_IO_URING
+// io_uring writer driven through the raw syscalls (no liburing needed).
+// Batches are packed into a small ring of chunks and submitted as
+// IORING_OP_WRITE requests, so up to queue_depth chunks are in flight while
+// the writer thread goes back to harvesting. flush() waits for all of them.
+class IoUringFileSink : public LogFileSink {
+ public:
+  explicit IoUringFileSink(unsigned queue_depth = 8,
+                           size_t chunk_size = 1024 * 1024)
+          : queue_depth_(std::clamp(queue_depth, 2u, 256u)),
+            chunk_size_(chunk_size) {
+    for (unsigned i = 0; i < queue_depth_; ++i) {
+      chunks_.emplace_back(new char[chunk_size_]);
+    }
+    chunk_len_.assign(queue_depth_, 0);
+    setupRing();
+  }
+  ~IoUringFileSink() override {
+    close();
+    teardownRing();
+  }
+
+  bool open(const std::string& fullname) override {
+    close();
+    fd_ = ::open(fullname.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+      std::cerr << "Can't open " << fullname << ": " << strerror(errno)
+                << "\n";
+      return false;
+    }
+    struct stat st;
+    offset_ = fstat(fd_, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+    return true;
+  }
+
+  void close() override {
+    if (fd_ >= 0) {
+      flush();
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  void write(const struct iovec* iov, int count) override {
+    if (fd_ < 0)
+      return;
+    for (int i = 0; i < count; ++i) {
+      auto data{ static_cast<const char*>(iov[i].iov_base) };
+      size_t len{ iov[i].iov_len };
+      while (len > 0) {
+        size_t& fill{ chunk_len_[current_] };
+        size_t n{ std::min(len, chunk_size_ - fill) };
+        memcpy(chunks_[current_].get() + fill, data, n);
+        fill += n;
+        data += n;
+        len -= n;
+        if (fill == chunk_size_)
+          submitCurrent();
+      }
+    }
+  }
+
+  void flush() override {
+    if (chunk_len_[current_] > 0)
+      submitCurrent();
+    while (in_flight_ > 0) {
+      reap(true);
+    }
+  }
+
+  uint64_t length() const override {
+    return offset_ + chunk_len_[current_];
+  }
+
+  int fd() const override {
+    return fd_;
+  }
+
+  bool ringReady() const {
+    return ring_fd_ >= 0;
+  }
+
+ protected:
+  void setupRing() {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring_fd_ = static_cast<int>(
+            ::syscall(__NR_io_uring_setup, queue_depth_, &params));
+    if (ring_fd_ < 0)
+      return;
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ =
+            params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap{ (params.features & IORING_FEAT_SINGLE_MMAP) != 0 };
+    if (single_mmap)
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+
+    sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    cq_ring_ = single_mmap ? sq_ring_
+                           : ::mmap(nullptr, cq_ring_size_,
+                                    PROT_READ | PROT_WRITE,
+                                    MAP_SHARED | MAP_POPULATE, ring_fd_,
+                                    IORING_OFF_CQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes{ ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring_fd_,
+                       IORING_OFF_SQES) };
+    if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED ||
+        sqes == MAP_FAILED) {
+      std::cerr << "io_uring mmap failed, falling back to pwrite\n";
+      teardownRing();
+      return;
+    }
+    single_mmap_ = single_mmap;
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    auto sq{ static_cast<char*>(sq_ring_) };
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    auto cq{ static_cast<char*>(cq_ring_) };
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+  }
+
+  void teardownRing() {
+    if (sqes_)
+      ::munmap(sqes_, sqes_size_);
+    if (cq_ring_ && cq_ring_ != MAP_FAILED && !single_mmap_)
+      ::munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_ && sq_ring_ != MAP_FAILED)
+      ::munmap(sq_ring_, sq_ring_size_);
+    if (ring_fd_ >= 0)
+      ::close(ring_fd_);
+    sqes_ = nullptr;
+    sq_ring_ = cq_ring_ = nullptr;
+    ring_fd_ = -1;
+  }
+
+  void submitCurrent() {
+    unsigned index{ current_ };
+    size_t len{ chunk_len_[index] };
+    if (ring_fd_ < 0) {
+      if (!internal::pwriteAll(fd_, chunks_[index].get(), len, offset_))
+        ++errors_;
+      offset_ += len;
+      chunk_len_[index] = 0;
+      return;
+    }
+
+    unsigned tail{ *sq_tail_ };
+    unsigned slot{ tail & sq_mask_ };
+    io_uring_sqe* sqe{ &sqes_[slot] };
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd_;
+    sqe->addr = reinterpret_cast<uint64_t>(chunks_[index].get());
+    sqe->len = static_cast<uint32_t>(len);
+    sqe->off = offset_;
+    sqe->user_data = (offset_ << 8) | index;
+    sq_array_[slot] = slot;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    ++unsubmitted_;
+    enter(0, 0);
+
+    offset_ += len;
+    ++in_flight_;
+    // Reuse the oldest chunk, waiting for it if it is still in flight
+    current_ = (current_ + 1) % queue_depth_;
+    while (chunk_len_[current_] != 0) {
+      reap(true);
+    }
+  }
+
+  void enter(unsigned min_complete, unsigned flags) {
+    long submitted{ ::syscall(__NR_io_uring_enter, ring_fd_, unsubmitted_,
+                              min_complete, flags, nullptr, 0) };
+    if (submitted > 0)
+      unsubmitted_ -= static_cast<unsigned>(submitted);
+  }
+
+  // Completes finished writes; a short or failed write is finished with
+  // a plain pwrite so the file never has holes
+  void reap(bool wait) {
+    unsigned head{ *cq_head_ };
+    if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+      if (wait)
+        enter(1, IORING_ENTER_GETEVENTS);
+      return;
+    }
+    while (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+      io_uring_cqe* cqe{ &cqes_[head & cq_mask_] };
+      auto index{ static_cast<unsigned>(cqe->user_data & 0xff) };
+      uint64_t offset{ cqe->user_data >> 8 };
+      size_t len{ chunk_len_[index] };
+      size_t done{ cqe->res > 0 ? static_cast<size_t>(cqe->res) : 0 };
+      if (done < len &&
+          !internal::pwriteAll(fd_, chunks_[index].get() + done, len - done,
+                               offset + done)) {
+        ++errors_;
+      }
+      chunk_len_[index] = 0;
+      --in_flight_;
+      ++head;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+  }
+
+  const unsigned queue_depth_;
+  const size_t chunk_size_;
+  std::vector<std::unique_ptr<char[]>> chunks_;
+  std::vector<size_t> chunk_len_;
+  unsigned current_{ 0 };
+  unsigned in_flight_{ 0 };
+  unsigned unsubmitted_{ 0 };
+  int fd_{ -1 };
+  uint64_t offset_{ 0 };
+
+  int ring_fd_{ -1 };
+  bool single_mmap_{ false };
+  void* sq_ring_{ nullptr };
+  void* cq_ring_{ nullptr };
+  size_t sq_ring_size_{ 0 };
+  size_t cq_ring_size_{ 0 };
+  size_t sqes_size_{ 0 };
+  io_uring_sqe* sqes_{ nullptr };
+  unsigned* sq_tail_{ nullptr };
+  unsigned sq_mask_{ 0 };
+  unsigned* sq_array_{ nullptr };
+  unsigned* cq_head_{ nullptr };
+  unsigned* cq_tail_{ nullptr };
+  unsigned cq_mask_{ 0 };
+  io_uring_cqe* cqes_{ nullptr };
+};
+#endif
+
+}  // namespace hlp
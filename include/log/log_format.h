@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+namespace hlp {
+namespace detail {
+inline constexpr size_t kBadFormat{ static_cast<size_t>(-1) };
+
+// Number of "{}" placeholders in fmt, or kBadFormat when a brace is neither
+// part of a placeholder nor escaped as "{{" / "}}"
+constexpr size_t countPlaceholders(std::string_view fmt) {
+  size_t count{ 0 };
+  for (size_t i = 0; i < fmt.size(); ++i) {
+    if (fmt[i] != '{' && fmt[i] != '}')
+      continue;
+    if (i + 1 >= fmt.size())
+      return kBadFormat;
+    if (fmt[i] == '{' && fmt[i + 1] == '}') {
+      ++count;
+    } else if (fmt[i + 1] != fmt[i]) {
+      return kBadFormat;
+    }
+    ++i;
+  }
+  return count;
+}
+
+// Position of the next brace token at or after pos, or fmt.size()
+constexpr size_t nextFormatToken(std::string_view fmt, size_t pos) {
+  for (; pos < fmt.size(); ++pos) {
+    if (fmt[pos] == '{' || fmt[pos] == '}')
+      return pos;
+  }
+  return fmt.size();
+}
+
+template <size_t Pos, typename Stream, typename Source, typename Arg,
+          typename... Rest>
+void formatArg(Stream& stream, Source source, const Arg& arg,
+               const Rest&... rest);
+
+// Walks the format string at compile time: each literal run becomes one
+// append() of a constant length and each "{}" one operator<< of its argument
+template <size_t Pos, typename Stream, typename Source, typename... Args>
+void formatFrom(Stream& stream, Source source, const Args&... args) {
+  constexpr std::string_view fmt{ source() };
+  constexpr size_t token{ nextFormatToken(fmt, Pos) };
+  if constexpr (token > Pos) {
+    stream.append(fmt.data() + Pos, token - Pos);
+  }
+  if constexpr (token < fmt.size()) {
+    if constexpr (fmt[token] == fmt[token + 1]) {
+      stream.append(fmt.data() + token, 1);
+      formatFrom<token + 2>(stream, source, args...);
+    } else {
+      formatArg<token + 2>(stream, source, args...);
+    }
+  }
+}
+
+template <size_t Pos, typename Stream, typename Source, typename Arg,
+          typename... Rest>
+void formatArg(Stream& stream, Source source, const Arg& arg,
+               const Rest&... rest) {
+  stream << arg;
+  formatFrom<Pos>(stream, source, rest...);
+}
+
+// source is a captureless lambda returning the format string, so that it
+// can be parsed in constant expressions
+template <typename Stream, typename Source, typename... Args>
+void formatTo(Stream& stream, Source source, const Args&... args) {
+  constexpr size_t count{ countPlaceholders(source()) };
+  static_assert(count != kBadFormat,
+                "unmatched '{' or '}' in log format string, use {{ or }}");
+  static_assert(count == kBadFormat || count == sizeof...(Args),
+                "log format string and argument count don't match");
+  if constexpr (count == sizeof...(Args)) {
+    formatFrom<0>(stream, source, args...);
+  }
+}
+}  // namespace detail
+}  // namespace hlp
+
+#define HLP_FMT_STRING_(format)                                                \
+  []() constexpr { return std::string_view(format); }
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace hlp {
+
+struct LogMergeStats {
+  uint64_t records_{ 0 };
+  // Records emitted after a record with a larger key: the reorder window
+  // was too small for how far the inputs were out of order
+  uint64_t out_of_order_{ 0 };
+};
+
+namespace detail {
+// Sort key of a line that starts a record: the "%016llX " sequence prefix
+// written by ShardedFileLogger, else the leading "yyyymmdd hh:mm:ss.uuuuuu"
+// timestamp. Both compare correctly as strings. Returns false for a line
+// with neither, which continues the record before it.
+inline bool logMergeKey(const std::string& line, std::string& key) {
+  constexpr size_t kSequenceDigits{ 16 };
+  constexpr std::string_view kTimeLayout{ "dddddddd dd:dd:dd.dddddd" };
+  if (line.size() > kSequenceDigits && line[kSequenceDigits] == ' ' &&
+      line.find_first_not_of("0123456789ABCDEFabcdef") == kSequenceDigits) {
+    key.assign(line, 0, kSequenceDigits);
+    return true;
+  }
+  if (line.size() < kTimeLayout.size())
+    return false;
+  for (size_t i = 0; i < kTimeLayout.size(); ++i) {
+    bool digit{ line[i] >= '0' && line[i] <= '9' };
+    if (kTimeLayout[i] == 'd' ? !digit : line[i] != kTimeLayout[i])
+      return false;
+  }
+  key.assign(line, 0, kTimeLayout.size());
+  return true;
+}
+}  // namespace detail
+
+// Merges shard files into out in key order. A record is a line with a key
+// plus the lines without one that follow it, such as the rest of a
+// multi-line message, and is moved as a whole. Each file only needs to be
+// roughly ordered: up to window records are held back and released
+// smallest key first, so a record may come up to window records after one
+// with a larger key in its own file. Files are read in step, always from
+// the one whose last record has the smallest key.
+inline bool mergeLogFiles(const std::vector<std::string>& files, FILE* out,
+                          size_t window = 1 << 20,
+                          LogMergeStats* stats = nullptr) {
+  struct Record {
+    std::string key_;
+    std::string text_;
+    uint64_t order_;
+    bool operator>(const Record& other) const {
+      return key_ != other.key_ ? key_ > other.key_ : order_ > other.order_;
+    }
+  };
+  struct Input {
+    std::ifstream stream_;
+    std::string last_key_;
+    // Still collecting continuation lines
+    Record record_;
+    bool has_record_{ false };
+  };
+
+  std::vector<Input> inputs(files.size());
+  for (size_t i = 0; i < files.size(); ++i) {
+    inputs[i].stream_.open(files[i], std::ios::binary);
+    if (!inputs[i].stream_)
+      return false;
+  }
+
+  std::priority_queue<Record, std::vector<Record>, std::greater<Record>>
+          pending;
+  LogMergeStats local_stats;
+  std::string last_key;
+  uint64_t order{ 0 };
+  auto emit{ [&]() {
+    const Record& record{ pending.top() };
+    if (record.key_ < last_key)
+      ++local_stats.out_of_order_;
+    last_key = record.key_;
+    fwrite(record.text_.data(), 1, record.text_.size(), out);
+    fputc('\n', out);
+    ++local_stats.records_;
+    pending.pop();
+  } };
+  auto push{ [&](Input& input) {
+    input.record_.order_ = order++;
+    pending.push(std::move(input.record_));
+    input.has_record_ = false;
+    if (pending.size() > window)
+      emit();
+  } };
+
+  std::string text;
+  std::string key;
+  for (;;) {
+    Input* next{ nullptr };
+    for (auto& input : inputs) {
+      if (input.stream_ &&
+          (!next || input.last_key_ < next->last_key_)) {
+        next = &input;
+      }
+    }
+    if (!next)
+      break;
+    if (!std::getline(next->stream_, text)) {
+      if (next->has_record_)
+        push(*next);
+      continue;
+    }
+    if (!detail::logMergeKey(text, key)) {
+      if (next->has_record_) {
+        next->record_.text_ += '\n';
+        next->record_.text_ += text;
+        continue;
+      }
+      // Lines ahead of the first key form a record with an empty one
+      key.clear();
+    }
+    if (next->has_record_)
+      push(*next);
+    next->record_.key_ = key;
+    next->record_.text_ = text;
+    next->has_record_ = true;
+    next->last_key_ = key;
+  }
+  while (!pending.empty()) {
+    emit();
+  }
+  if (stats)
+    *stats = local_stats;
+  return true;
+}
+
+}  // namespace hlp
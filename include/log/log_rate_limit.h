@@ -0,0 +1,213 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "logger.h"
+
+namespace hlp {
+namespace detail {
+// Verdict of a rate-limited call site: whether this call logs, and how many
+// calls were suppressed since the last one that did
+struct LogGate {
+  bool open_{ false };
+  uint64_t suppressed_{ 0 };
+
+  bool open() const {
+    return open_;
+  }
+  void close() {
+    open_ = false;
+  }
+};
+
+struct LogSuppressed {
+  uint64_t count_;
+};
+
+inline LogStream& operator<<(LogStream& stream, LogSuppressed note) {
+  if (note.count_ > 0) {
+    stream << '(' << static_cast<unsigned long long>(note.count_)
+           << " suppressed) ";
+  }
+  return stream;
+}
+
+inline int64_t steadyNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 std::chrono::steady_clock::now().time_since_epoch())
+          .count();
+}
+
+// Each Tag is a distinct closure type, giving every site its own state; a
+// statement discarded by HLP_LOG_ACTIVE_ never instantiates it
+template <typename Type, typename Tag>
+Type& logSiteState(Tag) {
+  static Type state;
+  return state;
+}
+}  // namespace detail
+
+// Per-site states used by the LOG_*_EVERY_N / FIRST_N / EVERY_MS /
+// RATE_LIMITED macros. They are constant-initialized statics, so a site
+// costs a few atomic operations and never takes a lock.
+class LogEveryN {
+ public:
+  detail::LogGate check(uint64_t n) {
+    uint64_t count{ count_.fetch_add(1, std::memory_order_relaxed) };
+    if (n <= 1)
+      return { true, 0 };
+    if (count % n != 0)
+      return {};
+    return { true, count == 0 ? 0 : n - 1 };
+  }
+
+ private:
+  std::atomic<uint64_t> count_{ 0 };
+};
+
+class LogFirstN {
+ public:
+  detail::LogGate check(uint64_t n) {
+    if (count_.load(std::memory_order_relaxed) >= n)
+      return {};
+    return { count_.fetch_add(1, std::memory_order_relaxed) < n, 0 };
+  }
+
+ private:
+  std::atomic<uint64_t> count_{ 0 };
+};
+
+class LogEveryMs {
+ public:
+  detail::LogGate check(int64_t interval_ms) {
+    int64_t now{ detail::steadyNanos() };
+    int64_t next{ next_ns_.load(std::memory_order_relaxed) };
+    if (now >= next &&
+        next_ns_.compare_exchange_strong(next, now + interval_ms * 1000000,
+                                         std::memory_order_relaxed)) {
+      return { true, suppressed_.exchange(0, std::memory_order_relaxed) };
+    }
+    suppressed_.fetch_add(1, std::memory_order_relaxed);
+    return {};
+  }
+
+ private:
+  std::atomic<int64_t> next_ns_{ 0 };
+  std::atomic<uint64_t> suppressed_{ 0 };
+};
+
+// Token bucket holding up to burst records and refilled at per_second,
+// kept as a single theoretical-arrival-time word (GCRA)
+class LogRateLimit {
+ public:
+  detail::LogGate check(double per_second, uint32_t burst) {
+    if (per_second > 0) {
+      auto interval{ static_cast<int64_t>(1e9 / per_second) };
+      int64_t tolerance{ interval * (std::max<uint32_t>(burst, 1) - 1) };
+      int64_t now{ detail::steadyNanos() };
+      int64_t tat{ tat_.load(std::memory_order_relaxed) };
+      for (;;) {
+        int64_t base{ std::max(tat, now) };
+        if (base - now > tolerance)
+          break;
+        if (tat_.compare_exchange_weak(tat, base + interval,
+                                       std::memory_order_relaxed)) {
+          return { true, suppressed_.exchange(0, std::memory_order_relaxed) };
+        }
+      }
+    }
+    suppressed_.fetch_add(1, std::memory_order_relaxed);
+    return {};
+  }
+
+ private:
+  std::atomic<int64_t> tat_{ 0 };
+  std::atomic<uint64_t> suppressed_{ 0 };
+};
+
+}  // namespace hlp
+
+#define HLP_LOG_SITE_STATE_(Type) (hlp::detail::logSiteState<Type>([]() {}))
+
+// The state is only touched when the level is enabled; the suppressed count
+// since the previous emitted line is written at the start of the message
+#define HLP_LOG_GATE_(level, Type, ...)                                        \
+  HLP_LOG_ACTIVE_(level)                                                       \
+  for (hlp::detail::LogGate _hlp_gate{                                         \
+               hlp::Logger::logLevel() <= level                                \
+                       ? HLP_LOG_SITE_STATE_(Type).check(__VA_ARGS__)          \
+                       : hlp::detail::LogGate{} };                             \
+       _hlp_gate.open(); _hlp_gate.close())
+
+#define HLP_LOG_LIMITED_(level, Type, ...)                                     \
+  HLP_LOG_GATE_(level, Type, __VA_ARGS__)                                      \
+  hlp::Logger(__FILE__, __LINE__, level).stream()                              \
+          << hlp::detail::LogSuppressed{ _hlp_gate.suppressed_ }
+
+// TRACE and DEBUG lines name the function, as LOG_TRACE and LOG_DEBUG do
+#define HLP_LOG_LIMITED_FUNC_(level, Type, ...)                                \
+  HLP_LOG_GATE_(level, Type, __VA_ARGS__)                                      \
+  hlp::Logger(__FILE__, __LINE__, level, __func__).stream()                    \
+          << hlp::detail::LogSuppressed{ _hlp_gate.suppressed_ }
+
+#define LOG_TRACE_EVERY_N(n)                                                   \
+  HLP_LOG_LIMITED_FUNC_(hlp::Logger::LogLevel::TRACE, hlp::LogEveryN, n)
+#define LOG_DEBUG_EVERY_N(n)                                                   \
+  HLP_LOG_LIMITED_FUNC_(hlp::Logger::LogLevel::DEBUG, hlp::LogEveryN, n)
+#define LOG_INFO_EVERY_N(n)                                                    \
+  HLP_LOG_LIMITED_(hlp::Logger::LogLevel::INFO, hlp::LogEveryN, n)
+#define LOG_WARN_EVERY_N(n)                                                    \
+  HLP_LOG_LIMITED_(hlp::Logger::LogLevel::WARN, hlp::LogEveryN, n)
+#define LOG_ERROR_EVERY_N(n)                                                   \
+  HLP_LOG_LIMITED_(hlp::Logger::LogLevel::ERROR, hlp::LogEveryN, n)
+#define LOG_FATAL_EVERY_N(n)                                                   \
+  HLP_LOG_LIMITED_(hlp::Logger::LogLevel::FATAL, hlp::LogEveryN, n)
+
+#define LOG_TRACE_FIRST_N(n)                                                   \
+  HLP_LOG_LIMITED_FUNC_(hlp::Logger::LogLevel::TRACE, hlp::LogFirstN, n)
+#define LOG_DEBUG_FIRST_N(n)                                                   \
+  HLP_LOG_LIMITED_FUNC_(hlp::Logger::LogLevel::DEBUG, hlp::LogFirstN, n)
+#define LOG_INFO_FIRST_N(n)                                                    \
+  HLP_LOG_LIMITED_(hlp::Logger::LogLevel::INFO, hlp::LogFirstN, n)
+#define LOG_WARN_FIRST_N(n)                                                    \
+  HLP_LOG_LIMITED_(hlp::Logger::LogLevel::WARN, hlp::LogFirstN, n)
+#define LOG_ERROR_FIRST_N(n)                                                   \
+  HLP_LOG_LIMITED_(hlp::Logger::LogLevel::ERROR, hlp::LogFirstN, n)
+#define LOG_FATAL_FIRST_N(n)                                                   \
+  HLP_LOG_LIMITED_(hlp::Logger::LogLevel::FATAL, hlp::LogFirstN, n)
+
+#define LOG_TRACE_EVERY_MS(ms)                                                 \
+  HLP_LOG_LIMITED_FUNC_(hlp::Logger::LogLevel::TRACE, hlp::LogEveryMs, ms)
+#define LOG_DEBUG_EVERY_MS(ms)                                                 \
+  HLP_LOG_LIMITED_FUNC_(hlp::Logger::LogLevel::DEBUG, hlp::LogEveryMs, ms)
+#define LOG_INFO_EVERY_MS(ms)                                                  \
+  HLP_LOG_LIMITED_(hlp::Logger::LogLevel::INFO, hlp::LogEveryMs, ms)
+#define LOG_WARN_EVERY_MS(ms)                                                  \
+  HLP_LOG_LIMITED_(hlp::Logger::LogLevel::WARN, hlp::LogEveryMs, ms)
+#define LOG_ERROR_EVERY_MS(ms)                                                 \
+  HLP_LOG_LIMITED_(hlp::Logger::LogLevel::ERROR, hlp::LogEveryMs, ms)
+#define LOG_FATAL_EVERY_MS(ms)                                                 \
+  HLP_LOG_LIMITED_(hlp::Logger::LogLevel::FATAL, hlp::LogEveryMs, ms)
+
+#define LOG_TRACE_RATE_LIMITED(per_second, burst)                              \
+  HLP_LOG_LIMITED_FUNC_(hlp::Logger::LogLevel::TRACE, hlp::LogRateLimit,       \
+                        per_second, burst)
+#define LOG_DEBUG_RATE_LIMITED(per_second, burst)                              \
+  HLP_LOG_LIMITED_FUNC_(hlp::Logger::LogLevel::DEBUG, hlp::LogRateLimit,       \
+                        per_second, burst)
+#define LOG_INFO_RATE_LIMITED(per_second, burst)                               \
+  HLP_LOG_LIMITED_(hlp::Logger::LogLevel::INFO, hlp::LogRateLimit,             \
+                   per_second, burst)
+#define LOG_WARN_RATE_LIMITED(per_second, burst)                               \
+  HLP_LOG_LIMITED_(hlp::Logger::LogLevel::WARN, hlp::LogRateLimit,             \
+                   per_second, burst)
+#define LOG_ERROR_RATE_LIMITED(per_second, burst)                              \
+  HLP_LOG_LIMITED_(hlp::Logger::LogLevel::ERROR, hlp::LogRateLimit,            \
+                   per_second, burst)
+#define LOG_FATAL_RATE_LIMITED(per_second, burst)                              \
+  HLP_LOG_LIMITED_(hlp::Logger::LogLevel::FATAL, hlp::LogRateLimit,            \
+                   per_second, burst)
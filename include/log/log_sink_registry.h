@@ -0,0 +1,225 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#if defined(__linux__)
+#include <sched.h>
+#endif
+#include "hlp/lock_free_queue.h"
+#include "logger.h"
+
+namespace hlp {
+
+// Destination of formatted log records. write() receives the caller's
+// buffer; sinks that keep the data must copy it.
+class LogSink {
+ public:
+  virtual ~LogSink() = default;
+  virtual void write(const char* msg, uint64_t len) = 0;
+  virtual void flush() {
+  }
+};
+using LogSinkPtr = std::shared_ptr<LogSink>;
+
+// Adapts an output/flush function pair, e.g. AsyncFileLogger::output
+class FunctionLogSink : public LogSink {
+ public:
+  FunctionLogSink(std::function<void(const char*, uint64_t)> output_func,
+                  std::function<void()> flush_func = {})
+          : output_func_(std::move(output_func)),
+            flush_func_(std::move(flush_func)) {
+  }
+
+  void write(const char* msg, uint64_t len) override {
+    output_func_(msg, len);
+  }
+
+  void flush() override {
+    if (flush_func_)
+      flush_func_();
+  }
+
+ private:
+  std::function<void(const char*, uint64_t)> output_func_;
+  std::function<void()> flush_func_;
+};
+
+class StdoutLogSink : public LogSink {
+ public:
+  void write(const char* msg, uint64_t len) override {
+    fwrite(msg, sizeof(char), len, stdout);
+  }
+
+  void flush() override {
+    fflush(stdout);
+  }
+};
+
+namespace internal {
+// CPU the caller runs on where the OS says, else a fixed number per thread;
+// spreads hot counters over cache lines
+inline size_t currentCpu() {
+#if defined(__linux__)
+  int cpu{ sched_getcpu() };
+  if (cpu >= 0)
+    return static_cast<size_t>(cpu);
+#endif
+  thread_local size_t id{ std::hash<std::thread::id>()(
+          std::this_thread::get_id()) };
+  return id;
+}
+}  // namespace internal
+
+// Set of sinks that every record fans out to. Readers never lock: they
+// enter a read-side section by bumping a counter of the current epoch
+// parity, one per CPU slot so writers on different CPUs don't share a
+// cache line, use the current immutable snapshot and leave. add()/remove()
+// publish a new snapshot under a mutex and, twice, flip the epoch and wait
+// until every slot of the old parity drops to zero before freeing the old
+// snapshot, so a removed sink is destroyed only after every write that
+// might still use it has returned.
+class LogSinkRegistry : public NonCopyable {
+ public:
+  static LogSinkRegistry& instance() {
+    static LogSinkRegistry registry;
+    return registry;
+  }
+
+  LogSinkRegistry()
+          : slot_count_(internal::roundUpPowerOfTwo(
+                    std::thread::hardware_concurrency())),
+            readers_(new ReaderCount[2 * slot_count_]) {
+  }
+  ~LogSinkRegistry() {
+    delete snapshot_.load(std::memory_order_relaxed);
+  }
+
+  void add(LogSinkPtr sink) {
+    update([&sink](Sinks& sinks) { sinks.push_back(std::move(sink)); });
+  }
+
+  bool remove(const LogSinkPtr& sink) {
+    bool found{ false };
+    update([&](Sinks& sinks) {
+      auto it{ std::find(sinks.begin(), sinks.end(), sink) };
+      if (it != sinks.end()) {
+        sinks.erase(it);
+        found = true;
+      }
+    });
+    return found;
+  }
+
+  void clear() {
+    update([](Sinks& sinks) { sinks.clear(); });
+  }
+
+  size_t size() const {
+    ReadSection section(*this);
+    return section.sinks().size();
+  }
+
+  // Hands the same buffer to every sink, in registration order
+  void write(const char* msg, uint64_t len) const {
+    ReadSection section(*this);
+    for (const auto& sink : section.sinks()) {
+      sink->write(msg, len);
+    }
+  }
+
+  void flush() const {
+    ReadSection section(*this);
+    for (const auto& sink : section.sinks()) {
+      sink->flush();
+    }
+  }
+
+  // Routes Logger output (all of it, or one index) through this registry
+  void install(int index = -1) {
+    Logger::setOutputFunction(
+            [this](const char* msg, const uint64_t len) { write(msg, len); },
+            [this]() { flush(); }, index);
+  }
+
+ private:
+  using Sinks = std::vector<LogSinkPtr>;
+
+  class ReadSection : public NonCopyable {
+   public:
+    explicit ReadSection(const LogSinkRegistry& registry)
+            : counter_(registry.readerCount(
+                      registry.epoch_.load(std::memory_order_relaxed),
+                      internal::currentCpu())) {
+      counter_.fetch_add(1, std::memory_order_seq_cst);
+      sinks_ = registry.snapshot_.load(std::memory_order_seq_cst);
+    }
+    ~ReadSection() {
+      counter_.fetch_sub(1, std::memory_order_release);
+    }
+
+    const Sinks& sinks() const {
+      return *sinks_;
+    }
+
+   private:
+    std::atomic<uint32_t>& counter_;
+    const Sinks* sinks_;
+  };
+
+  template <typename Fn>
+  void update(Fn&& fn) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    Sinks* old_sinks{ snapshot_.load(std::memory_order_relaxed) };
+    auto new_sinks{ std::make_unique<Sinks>(*old_sinks) };
+    fn(*new_sinks);
+    snapshot_.store(new_sinks.release(), std::memory_order_seq_cst);
+    synchronize();
+    delete old_sinks;
+  }
+
+  // Returns once every read section that could have seen the previous
+  // snapshot has ended
+  void synchronize() {
+    for (int phase = 0; phase < 2; ++phase) {
+      uint32_t old_epoch{ epoch_.load(std::memory_order_relaxed) };
+      epoch_.store(old_epoch + 1, std::memory_order_seq_cst);
+      for (size_t slot = 0; slot < slot_count_; ++slot) {
+        auto& counter{ readerCount(old_epoch, slot) };
+        for (int spins = 0;
+             counter.load(std::memory_order_acquire) != 0; ++spins) {
+          if (spins < 64) {
+            internal::cpuRelax();
+          } else {
+            std::this_thread::yield();
+          }
+        }
+      }
+    }
+  }
+
+  struct alignas(kCacheLineSize) ReaderCount {
+    std::atomic<uint32_t> count_{ 0 };
+  };
+
+  // Counters of one epoch parity are laid out together
+  std::atomic<uint32_t>& readerCount(uint32_t epoch, size_t cpu) const {
+    return readers_[(epoch & 1) * slot_count_ + (cpu & (slot_count_ - 1))]
+            .count_;
+  }
+
+  std::atomic<Sinks*> snapshot_{ new Sinks() };
+  std::atomic<uint32_t> epoch_{ 0 };
+  const size_t slot_count_;
+  std::unique_ptr<ReaderCount[]> readers_;
+  std::mutex writer_mutex_;
+};
+
+}  // namespace hlp
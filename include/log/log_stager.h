@@ -0,0 +1,841 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "hlp/date.h"
+#include "hlp/event_count.h"
+#include "hlp/non_copyable.h"
+#include "log_buffer_pool.h"
+#include "log_file_sink.h"
+
+namespace hlp {
+
+// Lock-free front end for a log sink such as AsyncFileLogger. Every producer
+// thread appends into its own chain of staging buffers drawn from a shared
+// LogBufferPool; a harvester thread collects full buffers as soon as they are
+// sealed and partially filled ("stale") ones every flush interval, hands
+// whole chunks to the sink and returns the buffers to the pool.
+// Records of one thread always reach the sink in the order they were logged.
+// With global merge enabled each record carries a timestamp and records
+// harvested in the same round are interleaved by time across threads.
+//
+//   hlp::AsyncFileLogger file_logger;
+//   file_logger.startLogging();
+//   hlp::LogStager stager(
+//           [&](const char* msg, const uint64_t len) {
+//             file_logger.output(msg, len);
+//           },
+//           [&]() { file_logger.flush(); });
+//   stager.start();
+//   hlp::Logger::setOutputFunction(
+//           [&](const char* msg, const uint64_t len) {
+//             stager.output(msg, len);
+//           },
+//           [&]() { stager.flush(); });
+//
+// Given a LogFileSink instead of an output function, each harvest round is
+// written to the file as a single iovec batch.
+//
+// When every staging buffer is taken the overflow policy decides what
+// happens to a record: DROP it, BLOCK the producer until the harvester
+// frees a buffer (up to a timeout), or SPILL it synchronously to a
+// secondary file. Independently, setDropLevel() sheds records below a level
+// once the pool runs low, keeping the last buffers for WARN and above.
+// telemetry() reports what was accepted and dropped per level, the queue
+// depth and how long producers and the writer stalled.
+class LogStager : NonCopyable {
+ public:
+  using OutputFunc = std::function<void(const char* msg, const uint64_t len)>;
+  using FlushFunc = std::function<void()>;
+  using StreamHeaderFunc = void (*)(std::string& header);
+
+  enum class OverflowPolicy { DROP, BLOCK, SPILL };
+
+  // Logger::LogLevel values, plus a slot for records whose level is not
+  // known or not found in Logger's line layout. kParseLevel asks output()
+  // to read the level from the record.
+  static constexpr int kLevelCount{ 6 };
+  static constexpr int kUnknownLevel{ kLevelCount };
+  static constexpr int kParseLevel{ -1 };
+
+  struct Telemetry {
+    uint64_t accepted_records_[kLevelCount + 1];
+    uint64_t accepted_bytes_[kLevelCount + 1];
+    uint64_t dropped_records_[kLevelCount + 1];
+    uint64_t dropped_bytes_[kLevelCount + 1];
+    uint64_t spilled_records_;
+    uint64_t spilled_bytes_;
+    // Staging buffers filled but not yet written, now and at most
+    size_t queue_depth_;
+    size_t queue_high_water_;
+    // Producers waiting for a buffer under OverflowPolicy::BLOCK
+    uint64_t blocked_count_;
+    int64_t blocked_nanos_;
+    // Time the harvester spent handing batches to the sink
+    uint64_t writes_;
+    int64_t write_nanos_;
+    int64_t max_write_nanos_;
+  };
+
+  explicit LogStager(OutputFunc output_func, FlushFunc flush_func = {})
+          : output_func_(std::move(output_func)),
+            flush_func_(std::move(flush_func)) {
+  }
+  explicit LogStager(LogFileSinkPtr file_sink)
+          : file_sink_(std::move(file_sink)) {
+  }
+  ~LogStager() {
+    stop();
+  }
+
+  // Settings below must be made before start() and before any thread logs
+  void setBufferSize(size_t size) {
+    buffer_size_ = size;
+  }
+  void setBufferCount(size_t count) {
+    buffer_count_ = std::max<size_t>(count, 2);
+  }
+  void setFlushInterval(std::chrono::milliseconds interval) {
+    flush_interval_ = interval;
+  }
+  void setGlobalMerge(bool flag = true) {
+    global_merge_ = flag;
+  }
+  void setOverflowPolicy(OverflowPolicy policy) {
+    overflow_policy_ = policy;
+  }
+  // Longest a producer waits for a buffer under OverflowPolicy::BLOCK
+  void setBlockTimeout(std::chrono::milliseconds timeout) {
+    block_timeout_ = timeout;
+  }
+  // Already opened file used by OverflowPolicy::SPILL. Spilled records are
+  // written in overflow order, not interleaved with the staged ones.
+  void setSpillSink(LogFileSinkPtr sink) {
+    spill_sink_ = std::move(sink);
+  }
+  // Records below level that need a new buffer are dropped once fewer than
+  // reserve_fraction of the pool's buffers are free
+  void setDropLevel(int level, double reserve_fraction = 0.25) {
+    drop_level_ = level;
+    drop_reserve_fraction_ = std::clamp(reserve_fraction, 0.0, 1.0);
+  }
+
+  // What func appends is written to the file sink ahead of the first batch
+  // the stager writes there, and each time the sink starts a new file
+  // (LogFileSink::rotations()) after the batch harvested in that round.
+  // Output functions can't report rotations. Safe to call at any time.
+  void setStreamHeader(StreamHeaderFunc func) {
+    stream_header_.store(func, std::memory_order_release);
+  }
+
+  // Unique for the life of the process, never reused
+  uint64_t id() const {
+    return id_;
+  }
+
+  void start() {
+    if (thread_ptr_)
+      return;
+    {
+      std::lock_guard<std::mutex> lock(stages_mutex_);
+      createArena();
+    }
+    drop_threshold_ = static_cast<size_t>(
+            arena_->pool_.bufferCount() * (1 - drop_reserve_fraction_));
+    stop_flag_.store(false, std::memory_order_relaxed);
+    thread_ptr_ =
+            std::make_unique<std::thread>([this]() { harvestThreadFunc(); });
+  }
+
+  void stop() {
+    if (thread_ptr_) {
+      stop_flag_.store(true, std::memory_order_relaxed);
+      wake_.notifyAll();
+      thread_ptr_->join();
+      thread_ptr_.reset();
+    }
+    flush();
+  }
+
+  // Hot path: no lock, no allocation once the thread's buffers are warm.
+  // Returns false if the record found no room and was spilled or dropped.
+  bool output(const char* msg, const uint64_t len, int level = kParseLevel) {
+    ThreadStage* stage{ localStage() };
+    if (stage->reserving_) {
+      stage->deferred_.append(msg, len);
+      return true;
+    }
+    if (level == kParseLevel)
+      level = recordLevel(msg, len);
+    char* dst{ reserve(stage, len, level, true) };
+    if (!dst) {
+      overflow(msg, len, level);
+      return false;
+    }
+    memcpy(dst, msg, len);
+    commit(stage, len);
+    return true;
+  }
+
+  // Zero-copy variant of output(): reserves max_len bytes inside the calling
+  // thread's current staging buffer so a record can be formatted in place,
+  // then publishes the first len of them with commit(len); commit(0) drops
+  // the reservation. Returns nullptr if no buffer is available or the thread
+  // already holds a reservation; reserve() never blocks, the overflow
+  // policy applies when the record is then passed to output(). Records
+  // output() while a reservation is open are appended after the reserved
+  // one. commit() without an open reservation is a no-op and len is
+  // clamped to max_len; both assert in debug builds.
+  char* reserve(size_t max_len, int level = kUnknownLevel) {
+    return reserve(localStage(), max_len, level, false);
+  }
+
+  void commit(size_t len) {
+    commit(localStage(), len);
+  }
+
+  // Harvests everything staged so far on the calling thread, then flushes
+  // the sink
+  void flush() {
+    {
+      std::lock_guard<std::mutex> lock(harvest_mutex_);
+      harvest();
+    }
+    if (file_sink_)
+      file_sink_->flush();
+    if (flush_func_)
+      flush_func_();
+    if (spill_sink_) {
+      std::lock_guard<std::mutex> lock(spill_mutex_);
+      spill_sink_->flush();
+    }
+  }
+
+  // Records dropped for any reason
+  uint64_t lostCount() const {
+    return lost_counter_.load(std::memory_order_relaxed);
+  }
+
+  // Exhaustion and occupancy figures of the staging buffer pool
+  LogBufferPool::Stats bufferPoolStats() {
+    std::lock_guard<std::mutex> lock(stages_mutex_);
+    createArena();
+    return arena_->pool_.stats();
+  }
+
+  Telemetry telemetry() {
+    Telemetry t{};
+    {
+      std::lock_guard<std::mutex> lock(stages_mutex_);
+      createArena();
+      LogBufferPool::Stats pool{ arena_->pool_.stats() };
+      // Every live thread holds one buffer it is still filling
+      t.queue_depth_ = pool.in_use_ - std::min(pool.in_use_, stages_.size());
+      t.queue_high_water_ = pool.high_water_;
+      for (int i = 0; i <= kLevelCount; ++i) {
+        t.accepted_records_[i] = retired_records_[i];
+        t.accepted_bytes_[i] = retired_bytes_[i];
+      }
+      for (auto& stage : stages_) {
+        for (int i = 0; i <= kLevelCount; ++i) {
+          t.accepted_records_[i] +=
+                  stage->accepted_records_[i].load(std::memory_order_relaxed);
+          t.accepted_bytes_[i] +=
+                  stage->accepted_bytes_[i].load(std::memory_order_relaxed);
+        }
+      }
+    }
+    for (int i = 0; i <= kLevelCount; ++i) {
+      t.dropped_records_[i] =
+              dropped_records_[i].load(std::memory_order_relaxed);
+      t.dropped_bytes_[i] = dropped_bytes_[i].load(std::memory_order_relaxed);
+    }
+    t.spilled_records_ = spilled_records_.load(std::memory_order_relaxed);
+    t.spilled_bytes_ = spilled_bytes_.load(std::memory_order_relaxed);
+    t.blocked_count_ = blocked_count_.load(std::memory_order_relaxed);
+    t.blocked_nanos_ = blocked_nanos_.load(std::memory_order_relaxed);
+    t.writes_ = writes_.load(std::memory_order_relaxed);
+    t.write_nanos_ = write_nanos_.load(std::memory_order_relaxed);
+    t.max_write_nanos_ = max_write_nanos_.load(std::memory_order_relaxed);
+    return t;
+  }
+
+  // Level of a record in Logger's layout,
+  //   yyyymmdd hh:mm:ss.uuuuuu [UTC ]<tid> <LEVEL> ...
+  // or kUnknownLevel
+  static int recordLevel(const char* msg, size_t len) {
+    constexpr size_t kTimeSize{ 25 };
+    if (len <= kTimeSize || msg[kTimeSize - 1] != ' ')
+      return kUnknownLevel;
+    size_t pos{ kTimeSize };
+    if (len > pos + 4 && memcmp(msg + pos, "UTC ", 4) == 0)
+      pos += 4;
+    while (pos < len && msg[pos] >= '0' && msg[pos] <= '9') {
+      ++pos;
+    }
+    if (pos + 1 >= len || msg[pos] != ' ')
+      return kUnknownLevel;
+    switch (msg[pos + 1]) {
+      case 'T':
+        return 0;
+      case 'D':
+        return 1;
+      case 'I':
+        return 2;
+      case 'W':
+        return 3;
+      case 'E':
+        return 4;
+      case 'F':
+        return 5;
+      default:
+        return kUnknownLevel;
+    }
+  }
+
+ protected:
+  struct RecordHeader {
+    int64_t micro_seconds_;
+    uint64_t length_;
+  };
+
+  // Bookkeeping for one staging buffer. Pooled buffers have a descriptor
+  // preallocated next to the pool; records larger than a pool buffer get a
+  // one-off heap buffer.
+  struct StageBuffer {
+    char* data_{ nullptr };
+    size_t capacity_{ 0 };
+    LogBuffer* pooled_{ nullptr };
+    std::unique_ptr<char[]> heap_data_;
+    std::atomic<size_t> committed_{ 0 };
+    std::atomic<bool> sealed_{ false };
+    std::atomic<StageBuffer*> next_{ nullptr };
+    size_t harvested_{ 0 };
+  };
+
+  struct BufferArena {
+    BufferArena(size_t buffer_count, size_t buffer_size)
+            : pool_(buffer_count, buffer_size),
+              descriptors_(new StageBuffer[pool_.bufferCount()]) {
+    }
+
+    StageBuffer* acquire(size_t need) {
+      StageBuffer* buf{ nullptr };
+      if (need <= pool_.bufferSize()) {
+        LogBuffer* pooled{ pool_.acquire() };
+        if (!pooled)
+          return nullptr;
+        buf = &descriptors_[pooled->index_];
+        buf->data_ = pooled->data_;
+        buf->capacity_ = pooled->capacity_;
+        buf->pooled_ = pooled;
+      } else {
+        buf = new StageBuffer;
+        buf->heap_data_.reset(new char[need]);
+        buf->data_ = buf->heap_data_.get();
+        buf->capacity_ = need;
+      }
+      buf->committed_.store(0, std::memory_order_relaxed);
+      buf->sealed_.store(false, std::memory_order_relaxed);
+      buf->next_.store(nullptr, std::memory_order_relaxed);
+      buf->harvested_ = 0;
+      return buf;
+    }
+
+    void release(StageBuffer* buf) {
+      if (buf->pooled_) {
+        pool_.release(buf->pooled_);
+      } else {
+        delete buf;
+      }
+    }
+
+    LogBufferPool pool_;
+    std::unique_ptr<StageBuffer[]> descriptors_;
+  };
+  using BufferArenaPtr = std::shared_ptr<BufferArena>;
+
+  struct ThreadStage {
+    explicit ThreadStage(BufferArenaPtr arena) : arena_(std::move(arena)) {
+      // A thread always owns a buffer; fall back to the heap if the pool is
+      // exhausted when it first logs
+      StageBuffer* buf{ arena_->acquire(1) };
+      if (!buf)
+        buf = arena_->acquire(arena_->pool_.bufferSize() + 1);
+      current_.store(buf, std::memory_order_relaxed);
+      harvest_buf_ = buf;
+    }
+    ~ThreadStage() {
+      StageBuffer* buf{ harvest_buf_ };
+      while (buf) {
+        StageBuffer* next{ buf->next_.load(std::memory_order_relaxed) };
+        arena_->release(buf);
+        buf = next;
+      }
+    }
+
+    BufferArenaPtr arena_;
+
+    // Producer side
+    std::atomic<StageBuffer*> current_{ nullptr };
+    bool reserving_{ false };
+    int reserve_level_{ kUnknownLevel };
+    size_t reserve_len_{ 0 };
+    std::string deferred_;
+    std::atomic<bool> retired_{ false };
+    // Written by the owning thread only, read by telemetry()
+    std::atomic<uint64_t> accepted_records_[kLevelCount + 1]{};
+    std::atomic<uint64_t> accepted_bytes_[kLevelCount + 1]{};
+
+    // Harvester side
+    StageBuffer* harvest_buf_{ nullptr };
+  };
+  using ThreadStagePtr = std::shared_ptr<ThreadStage>;
+
+  struct Span {
+    const char* data_;
+    size_t length_;
+  };
+
+  // Thread-local cache of the stages this thread owns, keyed by the unique
+  // id of each stager so a stager address reused later cannot alias. The
+  // stager owns the stages, so a destroyed stager's buffer pool goes with
+  // it; its expired entries are pruned when the thread next logs to a new
+  // stager.
+  struct LocalStages {
+    ~LocalStages() {
+      for (auto& entry : entries_) {
+        if (ThreadStagePtr stage = entry.second.lock())
+          stage->retired_.store(true, std::memory_order_release);
+      }
+    }
+
+    uint64_t last_id_{ 0 };
+    ThreadStage* last_stage_{ nullptr };
+    std::vector<std::pair<uint64_t, std::weak_ptr<ThreadStage>>> entries_;
+  };
+
+  static uint64_t nextStagerId() {
+    static std::atomic<uint64_t> id{ 0 };
+    return id.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+
+  static LocalStages& localStages() {
+    thread_local LocalStages stages;
+    return stages;
+  }
+
+  ThreadStage* localStage() {
+    LocalStages& stages{ localStages() };
+    if (stages.last_id_ == id_)
+      return stages.last_stage_;
+    // The stage lives as long as this stager, only this thread retires it
+    for (auto& entry : stages.entries_) {
+      if (entry.first == id_) {
+        stages.last_id_ = id_;
+        stages.last_stage_ = entry.second.lock().get();
+        return stages.last_stage_;
+      }
+    }
+    ThreadStagePtr stage;
+    {
+      std::lock_guard<std::mutex> lock(stages_mutex_);
+      createArena();
+      // Not make_shared: an expired entry must not hold the stage's memory
+      stage.reset(new ThreadStage(arena_));
+      stages_.push_back(stage);
+    }
+    stages.entries_.erase(
+            std::remove_if(stages.entries_.begin(), stages.entries_.end(),
+                           [](const auto& entry) {
+                             return entry.second.expired();
+                           }),
+            stages.entries_.end());
+    stages.entries_.emplace_back(id_, stage);
+    stages.last_id_ = id_;
+    stages.last_stage_ = stage.get();
+    return stages.last_stage_;
+  }
+
+  char* reserve(ThreadStage* stage, size_t max_len, int level,
+                bool may_block) {
+    if (stage->reserving_)
+      return nullptr;
+    size_t need{ global_merge_ ? max_len + sizeof(RecordHeader) : max_len };
+    StageBuffer* buf{ stage->current_.load(std::memory_order_relaxed) };
+    size_t pos{ buf->committed_.load(std::memory_order_relaxed) };
+    if (buf->capacity_ - pos < need) {
+      buf = advance(stage, need, level, may_block);
+      if (!buf)
+        return nullptr;
+      pos = 0;
+    }
+    stage->reserving_ = true;
+    stage->reserve_level_ = level;
+    stage->reserve_len_ = max_len;
+    char* dst{ buf->data_ + pos };
+    return global_merge_ ? dst + sizeof(RecordHeader) : dst;
+  }
+
+  void commit(ThreadStage* stage, size_t len) {
+    assert(stage->reserving_ && len <= stage->reserve_len_);
+    if (!stage->reserving_)
+      return;
+    stage->reserving_ = false;
+    publish(stage, std::min(len, stage->reserve_len_), stage->reserve_level_);
+    if (!stage->deferred_.empty()) {
+      std::string deferred;
+      deferred.swap(stage->deferred_);
+      output(deferred.data(), deferred.length());
+    }
+  }
+
+  void publish(ThreadStage* stage, size_t len, int level) {
+    if (len == 0)
+      return;
+    auto bump{ [](std::atomic<uint64_t>& counter, uint64_t n) {
+      counter.store(counter.load(std::memory_order_relaxed) + n,
+                    std::memory_order_relaxed);
+    } };
+    bump(stage->accepted_records_[level], 1);
+    bump(stage->accepted_bytes_[level], len);
+    StageBuffer* buf{ stage->current_.load(std::memory_order_relaxed) };
+    size_t pos{ buf->committed_.load(std::memory_order_relaxed) };
+    if (global_merge_) {
+      RecordHeader header{ Date::now().microSecondsSinceEpoch(),
+                           static_cast<uint64_t>(len) };
+      memcpy(buf->data_ + pos, &header, sizeof(header));
+      len += sizeof(header);
+    }
+    buf->committed_.store(pos + len, std::memory_order_release);
+  }
+
+  // Seals the thread's current buffer and links a fresh one behind it
+  StageBuffer* advance(ThreadStage* stage, size_t need, int level,
+                       bool may_block) {
+    if (level < drop_level_ &&
+        stage->arena_->pool_.inUse() >= drop_threshold_) {
+      return nullptr;
+    }
+    StageBuffer* next{ stage->arena_->acquire(need) };
+    if (!next && may_block && overflow_policy_ == OverflowPolicy::BLOCK)
+      next = waitForBuffer(stage, need);
+    if (!next)
+      return nullptr;
+
+    StageBuffer* cur{ stage->current_.load(std::memory_order_relaxed) };
+    cur->next_.store(next, std::memory_order_release);
+    cur->sealed_.store(true, std::memory_order_release);
+    stage->current_.store(next, std::memory_order_release);
+    wake_.notify();
+    return next;
+  }
+
+  StageBuffer* waitForBuffer(ThreadStage* stage, size_t need) {
+    blocked_count_.fetch_add(1, std::memory_order_relaxed);
+    auto start{ std::chrono::steady_clock::now() };
+    auto deadline{ start + block_timeout_ };
+    StageBuffer* next{ nullptr };
+    for (;;) {
+      auto key{ space_.prepareWait() };
+      next = stage->arena_->acquire(need);
+      auto now{ std::chrono::steady_clock::now() };
+      if (next || now >= deadline) {
+        space_.cancelWait();
+        break;
+      }
+      wake_.notify();
+      space_.waitFor(key, deadline - now);
+    }
+    blocked_nanos_.fetch_add(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start)
+                    .count(),
+            std::memory_order_relaxed);
+    return next;
+  }
+
+  // A record that found no room: spilled or counted as dropped
+  void overflow(const char* msg, size_t len, int level) {
+    if (overflow_policy_ == OverflowPolicy::SPILL && spill_sink_) {
+      struct iovec iov{ const_cast<char*>(msg), len };
+      {
+        std::lock_guard<std::mutex> lock(spill_mutex_);
+        spill_sink_->write(&iov, 1);
+      }
+      spilled_records_.fetch_add(1, std::memory_order_relaxed);
+      spilled_bytes_.fetch_add(len, std::memory_order_relaxed);
+      return;
+    }
+    lost_counter_.fetch_add(1, std::memory_order_relaxed);
+    dropped_records_[level].fetch_add(1, std::memory_order_relaxed);
+    dropped_bytes_[level].fetch_add(len, std::memory_order_relaxed);
+  }
+
+  // Called with stages_mutex_ held
+  void createArena() {
+    if (!arena_)
+      arena_ = std::make_shared<BufferArena>(buffer_count_, buffer_size_);
+  }
+
+  // Collects the unharvested bytes of one stage; sealed buffers whose bytes
+  // were all collected are queued for recycling once the spans are written
+  void collect(ThreadStage* stage, std::vector<Span>& spans,
+               std::vector<StageBuffer*>& done) {
+    StageBuffer* buf{ stage->harvest_buf_ };
+    for (;;) {
+      bool sealed{ buf->sealed_.load(std::memory_order_acquire) };
+      size_t committed{ buf->committed_.load(std::memory_order_acquire) };
+      if (committed > buf->harvested_) {
+        spans.push_back({ buf->data_ + buf->harvested_,
+                          committed - buf->harvested_ });
+        buf->harvested_ = committed;
+      }
+      if (!sealed)
+        break;
+      StageBuffer* next{ buf->next_.load(std::memory_order_acquire) };
+      done.push_back(buf);
+      buf = next;
+    }
+    stage->harvest_buf_ = buf;
+  }
+
+  void writeChunk(const char* data, size_t len) {
+    if (file_sink_) {
+      iov_.push_back({ const_cast<char*>(data), len });
+    } else {
+      output_func_(data, len);
+    }
+  }
+
+  void writeSpans(const std::vector<Span>& spans) {
+    for (auto& span : spans) {
+      writeChunk(span.data_, span.length_);
+    }
+  }
+
+  // Interleaves the framed records of every stage by timestamp while keeping
+  // each stage's own order; returns false when there was nothing to write
+  bool writeMerged(const std::vector<std::vector<Span>>& stage_spans) {
+    struct Cursor {
+      int64_t micro_seconds_;
+      size_t stage_;
+      size_t span_;
+      size_t offset_;
+      bool operator>(const Cursor& other) const {
+        return micro_seconds_ > other.micro_seconds_;
+      }
+    };
+    auto headerAt{ [&stage_spans](const Cursor& c) {
+      RecordHeader header;
+      memcpy(&header, stage_spans[c.stage_][c.span_].data_ + c.offset_,
+             sizeof(header));
+      return header;
+    } };
+    std::priority_queue<Cursor, std::vector<Cursor>, std::greater<Cursor>>
+            heads;
+    for (size_t i = 0; i < stage_spans.size(); ++i) {
+      if (!stage_spans[i].empty()) {
+        Cursor c{ 0, i, 0, 0 };
+        c.micro_seconds_ = headerAt(c).micro_seconds_;
+        heads.push(c);
+      }
+    }
+
+    merge_buffer_.clear();
+    while (!heads.empty()) {
+      Cursor c{ heads.top() };
+      heads.pop();
+      RecordHeader header{ headerAt(c) };
+      const Span& span{ stage_spans[c.stage_][c.span_] };
+      merge_buffer_.append(span.data_ + c.offset_ + sizeof(header),
+                           header.length_);
+      c.offset_ += sizeof(header) + header.length_;
+      if (c.offset_ >= span.length_) {
+        c.offset_ = 0;
+        if (++c.span_ == stage_spans[c.stage_].size())
+          continue;
+      }
+      c.micro_seconds_ = headerAt(c).micro_seconds_;
+      heads.push(c);
+    }
+    if (merge_buffer_.empty())
+      return false;
+    writeChunk(merge_buffer_.data(), merge_buffer_.length());
+    return true;
+  }
+
+  void harvest() {
+    {
+      std::lock_guard<std::mutex> lock(stages_mutex_);
+      harvest_stages_ = stages_;
+    }
+    stage_spans_.resize(harvest_stages_.size());
+    done_buffers_.resize(harvest_stages_.size());
+    std::vector<bool> retired(harvest_stages_.size());
+    for (size_t i = 0; i < harvest_stages_.size(); ++i) {
+      retired[i] = harvest_stages_[i]->retired_.load(std::memory_order_acquire);
+      stage_spans_[i].clear();
+      collect(harvest_stages_[i].get(), stage_spans_[i], done_buffers_[i]);
+    }
+
+    auto start{ std::chrono::steady_clock::now() };
+    bool wrote{ false };
+    if (global_merge_) {
+      wrote = writeMerged(stage_spans_);
+    } else {
+      for (auto& spans : stage_spans_) {
+        wrote = wrote || !spans.empty();
+        writeSpans(spans);
+      }
+    }
+    if (!iov_.empty()) {
+      // An existing file opened for appending gets a header between the
+      // previous run's records and ours
+      if (!stream_started_)
+        writeStreamHeader();
+      file_sink_->write(iov_.data(), static_cast<int>(iov_.size()));
+      iov_.clear();
+    }
+    if (file_sink_ && file_sink_->rotations() != rotations_)
+      writeStreamHeader();
+    if (wrote) {
+      int64_t nanos{ std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - start)
+                             .count() };
+      writes_.fetch_add(1, std::memory_order_relaxed);
+      write_nanos_.fetch_add(nanos, std::memory_order_relaxed);
+      if (nanos > max_write_nanos_.load(std::memory_order_relaxed))
+        max_write_nanos_.store(nanos, std::memory_order_relaxed);
+    }
+
+    bool released{ false };
+    for (size_t i = 0; i < harvest_stages_.size(); ++i) {
+      for (auto* buf : done_buffers_[i]) {
+        harvest_stages_[i]->arena_->release(buf);
+        released = true;
+      }
+      done_buffers_[i].clear();
+    }
+    if (released)
+      space_.notifyAll();
+
+    bool has_retired{ std::find(retired.begin(), retired.end(), true) !=
+                      retired.end() };
+    if (has_retired) {
+      std::lock_guard<std::mutex> lock(stages_mutex_);
+      for (size_t i = 0; i < harvest_stages_.size(); ++i) {
+        if (retired[i]) {
+          ThreadStage& stage{ *harvest_stages_[i] };
+          for (int l = 0; l <= kLevelCount; ++l) {
+            retired_records_[l] +=
+                    stage.accepted_records_[l].load(std::memory_order_relaxed);
+            retired_bytes_[l] +=
+                    stage.accepted_bytes_[l].load(std::memory_order_relaxed);
+          }
+          stages_.erase(std::find(stages_.begin(), stages_.end(),
+                                  harvest_stages_[i]));
+        }
+      }
+    }
+    harvest_stages_.clear();
+  }
+
+  void writeStreamHeader() {
+    rotations_ = file_sink_->rotations();
+    StreamHeaderFunc func{ stream_header_.load(std::memory_order_acquire) };
+    if (!func)
+      return;
+    stream_started_ = true;
+    header_buffer_.clear();
+    func(header_buffer_);
+    if (!header_buffer_.empty()) {
+      struct iovec iov{ &header_buffer_[0], header_buffer_.length() };
+      file_sink_->write(&iov, 1);
+      // A header that fills the file on its own is not repeated
+      rotations_ = file_sink_->rotations();
+    }
+  }
+
+  void harvestThreadFunc() {
+    while (!stop_flag_.load(std::memory_order_relaxed)) {
+      auto key{ wake_.prepareWait() };
+      if (stop_flag_.load(std::memory_order_relaxed)) {
+        wake_.cancelWait();
+        break;
+      }
+      bool woken{ wake_.waitFor(key, flush_interval_) };
+      std::lock_guard<std::mutex> lock(harvest_mutex_);
+      harvest();
+      // Idle rounds push buffered sink data (an O_DIRECT tail) to the kernel
+      if (!woken && file_sink_)
+        file_sink_->flush();
+    }
+  }
+
+  OutputFunc output_func_;
+  FlushFunc flush_func_;
+  LogFileSinkPtr file_sink_;
+  const uint64_t id_{ nextStagerId() };
+  size_t buffer_size_{ 64 * 1024 };
+  size_t buffer_count_{ 1024 };
+  std::chrono::milliseconds flush_interval_{ 100 };
+  bool global_merge_{ false };
+  OverflowPolicy overflow_policy_{ OverflowPolicy::DROP };
+  std::chrono::milliseconds block_timeout_{ 100 };
+  int drop_level_{ 0 };
+  double drop_reserve_fraction_{ 0.25 };
+  size_t drop_threshold_{ SIZE_MAX };
+
+  std::mutex spill_mutex_;
+  LogFileSinkPtr spill_sink_;
+
+  std::mutex stages_mutex_;
+  BufferArenaPtr arena_;
+  std::vector<ThreadStagePtr> stages_;
+  // Accepted counts of threads that have exited
+  uint64_t retired_records_[kLevelCount + 1]{};
+  uint64_t retired_bytes_[kLevelCount + 1]{};
+
+  std::mutex harvest_mutex_;
+  std::vector<ThreadStagePtr> harvest_stages_;
+  std::vector<std::vector<Span>> stage_spans_;
+  std::vector<std::vector<StageBuffer*>> done_buffers_;
+  std::string merge_buffer_;
+  std::vector<struct iovec> iov_;
+  std::atomic<StreamHeaderFunc> stream_header_{ nullptr };
+  size_t rotations_{ 0 };
+  bool stream_started_{ false };
+  std::string header_buffer_;
+
+  EventCount wake_;
+  // Signalled when the harvester returns buffers to the pool
+  EventCount space_;
+  std::atomic<bool> stop_flag_{ false };
+  std::unique_ptr<std::thread> thread_ptr_;
+  std::atomic<uint64_t> lost_counter_{ 0 };
+  std::atomic<uint64_t> dropped_records_[kLevelCount + 1]{};
+  std::atomic<uint64_t> dropped_bytes_[kLevelCount + 1]{};
+  std::atomic<uint64_t> spilled_records_{ 0 };
+  std::atomic<uint64_t> spilled_bytes_{ 0 };
+  std::atomic<uint64_t> blocked_count_{ 0 };
+  std::atomic<int64_t> blocked_nanos_{ 0 };
+  std::atomic<uint64_t> writes_{ 0 };
+  std::atomic<int64_t> write_nanos_{ 0 };
+  std::atomic<int64_t> max_write_nanos_{ 0 };
+};
+
+}  // namespace hlp
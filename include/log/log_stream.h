@@ -1,12 +1,17 @@
 #pragma once
 
 #include "hlp/non_copyable.h"
+#include "hlp/number_format.h"
 #include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <limits>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
 namespace hlp {
 class Fmt {
@@ -37,39 +42,14 @@ inline const char* zero = digits + 9;
 
 template <typename T>
 size_t convert(char buf[], T value) {
-  T i = value;
-  char* p = buf;
-
-  do {
-    int lsd = static_cast<int>(i % 10);
-    *p++ = zero[lsd];
-    i /= 10;
-
-  } while (i);
-
-  if (value < 0) {
-    *p++ = '-';
-  }
-  *p = '\0';
-  std::reverse(buf, p);
-
-  return p - buf;
+  size_t len{ internal::formatInteger(buf, value) };
+  buf[len] = '\0';
+  return len;
 }
 inline size_t convertHex(char buf[], uintptr_t value) {
-  uintptr_t i = value;
-  char* p = buf;
-
-  do {
-    int lsd = static_cast<int>(i % 16);
-    *p++ = digits[lsd];
-    i /= 16;
-
-  } while (i);
-
-  *p = '\0';
-  std::reverse(buf, p);
-
-  return p - buf;
+  size_t len{ internal::formatHex(buf, value) };
+  buf[len] = '\0';
+  return len;
 }
 
 template <int SIZE>
@@ -114,6 +94,9 @@ class FixedBuffer : NonCopyable {
   const char* data() const {
     return data_;
   }
+  char* data() {
+    return data_;
+  }
   const char* start() const {
     return data_;
   }
@@ -141,6 +124,35 @@ class FixedBuffer : NonCopyable {
   char* cur_{};
 };
 }  // namespace detail
+class LogStream;
+
+namespace detail {
+// Continues a run of structured fields started by LogStream::kv() and, for
+// JSON, closes the object when the log statement ends. Text streamed into
+// it goes ahead of the fields, so they stay at the end of the line.
+class KvWriter : NonCopyable {
+ public:
+  KvWriter(LogStream& stream, bool json, size_t start)
+          : stream_(stream), json_(json), text_end_(start) {
+  }
+  KvWriter(KvWriter&&) = delete;
+  ~KvWriter();
+
+  template <size_t N, typename T>
+  KvWriter& kv(const char (&name)[N], const T& value);
+
+  template <typename T>
+  KvWriter& operator<<(const T& value);
+
+ private:
+  LogStream& stream_;
+  bool json_;
+  // Where streamed text is inserted, just before the fields
+  size_t text_end_;
+  bool has_text_{ false };
+};
+}  // namespace detail
+
 class LogStream : NonCopyable {
   using sel = LogStream;
   using Buffer = detail::FixedBuffer<detail::kSmallBuffer>;
@@ -176,6 +188,34 @@ class LogStream : NonCopyable {
     ex_buffer_.clear();
   }
 
+  // Encoding of kv() fields: logfmt ` key=value key2="a b"` or a JSON
+  // object ` {"key":value,"key2":"a b"}` after the message text
+  enum class KvFormat { LOGFMT, JSON };
+
+  static void setKvFormat(KvFormat format) {
+    kvFormatFlag().store(format == KvFormat::JSON, std::memory_order_relaxed);
+  }
+
+  static KvFormat kvFormat() {
+    return kvFormatFlag().load(std::memory_order_relaxed) ? KvFormat::JSON
+                                                          : KvFormat::LOGFMT;
+  }
+
+  // LOG_INFO.kv("order_id", id).kv("px", px) << "filled". Names are
+  // string literals written as is; values are escaped and quoted as the
+  // format requires. The message text may come before or after the fields.
+  template <size_t N, typename T>
+  detail::KvWriter kv(const char (&name)[N], const T& value) {
+    bool json{ kvFormatFlag().load(std::memory_order_relaxed) };
+    size_t len{ bufferLength() };
+    if (len > 0 && bufferData()[len - 1] != ' ') {
+      append(" ", 1);
+      ++len;
+    }
+    appendKv(json, json ? '{' : '\0', name, value);
+    return detail::KvWriter(*this, json, len);
+  }
+
   sel& operator<<(bool v) {
     append(v ? "1" : "0", 1);
     return *this;
@@ -248,19 +288,15 @@ class LogStream : NonCopyable {
     return *this;
   }
   sel& operator<<(const double& v) {
-    constexpr static int kMaxNumericSize = 32;
-    if (ex_buffer_.empty()) {
-      if (buffer_.avail() >= kMaxNumericSize) {
-        int len = snprintf(buffer_.current(), kMaxNumericSize, "%.12g", v);
-        buffer_.add(len);
-        return *this;
-      }
-      ex_buffer_.append(buffer_.data(), buffer_.length());
-    }
-    auto old_len = ex_buffer_.length();
-    ex_buffer_.resize(old_len + kMaxNumericSize);
-    int len = snprintf(&ex_buffer_[old_len], kMaxNumericSize, "%.12g", v);
-    ex_buffer_.resize(old_len + len);
+    formatNumber(internal::kMaxFloatSize, [v](char* buf) {
+      return internal::formatDouble(buf, v);
+    });
+    return *this;
+  }
+  sel& operator<<(const FixedFloat& v) {
+    formatNumber(internal::kMaxFloatSize, [v](char* buf) {
+      return internal::formatFixed(buf, v.value_, v.precision_);
+    });
     return *this;
   }
   sel& operator<<(const long double& v) {
@@ -279,8 +315,11 @@ class LogStream : NonCopyable {
     ex_buffer_.resize(old_len + len);
     return *this;
   }
-  sel& operator<<(float& v) {
-    return operator<<(static_cast<double>(v));
+  sel& operator<<(const float& v) {
+    formatNumber(internal::kMaxFloatSize, [v](char* buf) {
+      return internal::formatFloat(buf, v);
+    });
+    return *this;
   }
 
   sel& operator<<(const void* p) {
@@ -310,9 +349,147 @@ class LogStream : NonCopyable {
   }
 
  private:
+  friend class detail::KvWriter;
+
   Buffer buffer_{};
   std::string ex_buffer_{};
 
+  // Moves the bytes from offset from to the end of the buffer to offset to,
+  // shifting those in between behind them
+  void moveTail(size_t to, size_t from) {
+    char* data{ ex_buffer_.empty() ? buffer_.data() : &ex_buffer_[0] };
+    std::rotate(data + to, data + from, data + bufferLength());
+  }
+
+  static std::atomic<bool>& kvFormatFlag() {
+    static std::atomic<bool> json{ false };
+    return json;
+  }
+
+  // Writes lead (if any), the key and its separator with one copy when
+  // the fixed buffer has room, then the value
+  template <size_t N, typename T>
+  void appendKv(bool json, char lead, const char (&name)[N], const T& value) {
+    char key[N + 4];
+    char* p{ key };
+    if (lead != '\0')
+      *p++ = lead;
+    if (json)
+      *p++ = '"';
+    memcpy(p, name, N - 1);
+    p += N - 1;
+    if (json)
+      *p++ = '"';
+    *p++ = json ? ':' : '=';
+    append(key, static_cast<size_t>(p - key));
+    appendKvValue(json, value);
+  }
+
+  template <typename T>
+  void appendKvValue(bool json, const T& value) {
+    if constexpr (std::is_same_v<T, bool>) {
+      if (value) {
+        append("true", 4);
+      } else {
+        append("false", 5);
+      }
+    } else if constexpr (std::is_same_v<T, char>) {
+      appendKvString(json, std::string_view(&value, 1));
+    } else if constexpr (std::is_integral_v<T>) {
+      formatInteger(value);
+    } else if constexpr (std::is_floating_point_v<T>) {
+      if (json && !std::isfinite(value)) {
+        append("null", 4);
+      } else {
+        operator<<(value);
+      }
+    } else if constexpr (std::is_same_v<T, FixedFloat>) {
+      if (json && !std::isfinite(value.value_)) {
+        append("null", 4);
+      } else {
+        operator<<(value);
+      }
+    } else if constexpr (std::is_convertible_v<const T&, const char*>) {
+      const char* str{ value };
+      if (str) {
+        appendKvString(json, str);
+      } else {
+        append("null", 4);
+      }
+    } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+      appendKvString(json, std::string_view(value));
+    } else if constexpr (std::is_pointer_v<T>) {
+      char buf[2 + 2 * sizeof(uintptr_t)];
+      buf[0] = '0';
+      buf[1] = 'x';
+      size_t len{ 2 + internal::formatHex(buf + 2,
+                                          reinterpret_cast<uintptr_t>(value)) };
+      appendKvString(json, std::string_view(buf, len));
+    } else {
+      static_assert(std::is_arithmetic_v<T>,
+                    "kv() takes numbers, strings, bool and pointers");
+    }
+  }
+
+  // JSON strings are always quoted; logfmt ones only when empty or when
+  // they hold a space, '=', a quote, a backslash or a control character
+  void appendKvString(bool json, std::string_view str) {
+    auto needs_escape{ [](unsigned char c) {
+      return c < 0x20 || c == '"' || c == '\\';
+    } };
+    bool quote{ json || str.empty() };
+    for (size_t i = 0; !quote && i < str.size(); ++i) {
+      auto c{ static_cast<unsigned char>(str[i]) };
+      quote = c <= ' ' || c == '=' || needs_escape(c);
+    }
+    if (!quote) {
+      append(str.data(), str.size());
+      return;
+    }
+    append("\"", 1);
+    size_t run{ 0 };
+    for (size_t i = 0; i < str.size(); ++i) {
+      auto c{ static_cast<unsigned char>(str[i]) };
+      if (!needs_escape(c))
+        continue;
+      append(str.data() + run, i - run);
+      run = i + 1;
+      char escaped[6]{ '\\', static_cast<char>(c) };
+      size_t len{ 2 };
+      if (c == '\n') {
+        escaped[1] = 'n';
+      } else if (c == '\r') {
+        escaped[1] = 'r';
+      } else if (c == '\t') {
+        escaped[1] = 't';
+      } else if (c < 0x20) {
+        memcpy(escaped + 1, "u00", 3);
+        escaped[4] = detail::digits_hex[c >> 4];
+        escaped[5] = detail::digits_hex[c & 0xf];
+        len = 6;
+      }
+      append(escaped, len);
+    }
+    append(str.data() + run, str.size() - run);
+    append("\"", 1);
+  }
+
+  // Runs fmt on at least max_len free bytes, in the fixed buffer if possible
+  template <typename Formatter>
+  void formatNumber(size_t max_len, Formatter&& fmt) {
+    if (ex_buffer_.empty()) {
+      if (static_cast<size_t>(buffer_.avail()) >= max_len) {
+        buffer_.add(fmt(buffer_.current()));
+        return;
+      }
+      ex_buffer_.append(buffer_.start(), buffer_.length());
+    }
+    auto old_len = ex_buffer_.length();
+    ex_buffer_.resize(old_len + max_len);
+    size_t len = fmt(&ex_buffer_[old_len]);
+    ex_buffer_.resize(old_len + len);
+  }
+
   template <typename T>
   void formatInteger(T v) {
     static constexpr int kMaxNumericSize = std::numeric_limits<T>::digits10 + 4;
@@ -330,4 +507,33 @@ class LogStream : NonCopyable {
     ex_buffer_.resize(old_len + len);
   }
 };
+
+namespace detail {
+inline KvWriter::~KvWriter() {
+  if (json_)
+    stream_.append("}", 1);
+}
+
+template <size_t N, typename T>
+KvWriter& KvWriter::kv(const char (&name)[N], const T& value) {
+  stream_.appendKv(json_, json_ ? ',' : ' ', name, value);
+  return *this;
+}
+
+template <typename T>
+KvWriter& KvWriter::operator<<(const T& value) {
+  if (!has_text_) {
+    // Separates the text from the fields
+    stream_.append(" ", 1);
+    stream_.moveTail(text_end_, stream_.bufferLength() - 1);
+    has_text_ = true;
+  }
+  size_t end{ stream_.bufferLength() };
+  stream_ << value;
+  size_t len{ stream_.bufferLength() - end };
+  stream_.moveTail(text_end_, end);
+  text_end_ += len;
+  return *this;
+}
+}  // namespace detail
 }  // namespace hlp
@@ -2,11 +2,26 @@
 
 #include <memory>
 #include "hlp/date.h"
+#include "log_format.h"
 #include "log_stream.h"
 #include <iostream>
 
 #define LOGGER_IF_(cond) for (int _r{ 0 }; _r == 0 && cond; ++_r)
 
+// Levels below HLP_LOG_ACTIVE_LEVEL (0 = TRACE ... 5 = FATAL) are removed at
+// compile time: their macros expand to a discarded if constexpr branch, so
+// neither the Logger nor the streamed arguments are compiled in.
+#ifndef HLP_LOG_ACTIVE_LEVEL
+#ifdef NLOG
+#define HLP_LOG_ACTIVE_LEVEL 1
+#else
+#define HLP_LOG_ACTIVE_LEVEL 0
+#endif
+#endif
+#define HLP_LOG_ACTIVE_(level)                                                 \
+  if constexpr ((level) < HLP_LOG_ACTIVE_LEVEL) {                              \
+  } else
+
 namespace spdlog {
 class logger;
 }
@@ -222,20 +237,24 @@ class Logger : public NonCopyable {
 
 #ifdef NLOG
 #define LOG_TRACE                                                              \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::TRACE)                                \
   LOGGER_IF_(0)                                                                \
   hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::TRACE, __func__)      \
           .stream()
 #else
 #define LOG_TRACE                                                              \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::TRACE)                                \
   LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::TRACE)          \
   hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::TRACE, __func__)      \
           .stream()
 #define LOG_TRACE_TO(index)                                                    \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::TRACE)                                \
   LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::TRACE)          \
   hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::TRACE, __func__)      \
           .setIndex(index)                                                     \
           .stream()
 #define LOG_TRACE_IF(cond)                                                     \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::TRACE)                                \
   LOGGER_IF_((hlp::Logger::logLevel() <= hlp::Logger::LogLevel::TRACE) &&      \
              (cond))                                                           \
   hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::TRACE, __func__)      \
@@ -243,101 +262,126 @@ class Logger : public NonCopyable {
 #endif
 
 #define LOG_DEBUG_COMPACT                                                      \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::DEBUG)                                \
   LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::DEBUG)          \
   hlp::Logger(hlp::Logger::LogLevel::DEBUG).stream()
 #define LOG_DEBUG                                                              \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::DEBUG)                                \
   LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::DEBUG)          \
   hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::DEBUG, __func__)      \
           .stream()
 #define LOG_DEBUG_COMPACT_TO(index)                                            \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::DEBUG)                                \
   LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::DEBUG)          \
   hlp::Logger(hlp::Logger::LogLevel::DEBUG).setIndex(index).stream()
 #define LOG_DEBUG_TO(index)                                                    \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::DEBUG)                                \
   LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::DEBUG)          \
   hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::DEBUG, __func__)      \
           .setIndex(index)                                                     \
           .stream()
 #define LOG_DEBUG_IF(cond)                                                     \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::DEBUG)                                \
   LOGGER_IF_((hlp::Logger::logLevel() <= hlp::Logger::LogLevel::DEBUG) &&      \
              (cond))                                                           \
   hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::DEBUG, __func__)      \
           .stream()
 
 #define LOG_INFO_COMPACT                                                       \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::INFO)                                 \
   LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::INFO)           \
   hlp::Logger(hlp::Logger::LogLevel::INFO).stream()
 #define LOG_INFO                                                               \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::INFO)                                 \
   LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::INFO)           \
   hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::INFO).stream()
 #define LOG_INFO_COMPACT_TO(index)                                             \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::INFO)                                 \
   LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::INFO)           \
   hlp::Logger(hlp::Logger::LogLevel::INFO).setIndex(index).stream()
 #define LOG_INFO_TO(index)                                                     \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::INFO)                                 \
   LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::INFO)           \
   hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::INFO)                 \
           .setIndex(index)                                                     \
           .stream()
 #define LOG_INFO_IF(cond)                                                      \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::INFO)                                 \
   LOGGER_IF_((hlp::Logger::logLevel() <= hlp::Logger::LogLevel::INFO) &&       \
              (cond))                                                           \
   hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::INFO, __func__)       \
           .stream()
 
 #define LOG_WARN_COMPACT                                                       \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::WARN)                                 \
   LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::WARN)           \
   hlp::Logger(hlp::Logger::LogLevel::WARN).stream()
 #define LOG_WARN                                                               \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::WARN)                                 \
   LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::WARN)           \
   hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::WARN).stream()
 #define LOG_WARN_COMPACT_TO(index)                                             \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::WARN)                                 \
   LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::WARN)           \
   hlp::Logger(hlp::Logger::LogLevel::WARN).setIndex(index).stream()
 #define LOG_WARN_TO(index)                                                     \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::WARN)                                 \
   LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::WARN)           \
   hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::WARN)                 \
           .setIndex(index)                                                     \
           .stream()
 #define LOG_WARN_IF(cond)                                                      \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::WARN)                                 \
   LOGGER_IF_((hlp::Logger::logLevel() <= hlp::Logger::LogLevel::WARN) &&       \
              (cond))                                                           \
   hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::WARN, __func__)       \
           .stream()
 
 #define LOG_ERROR_COMPACT                                                      \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::ERROR)                                \
   LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::ERROR)          \
   hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::ERROR).stream()
 #define LOG_ERROR                                                              \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::ERROR)                                \
   LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::ERROR)          \
   hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::ERROR).stream()
 #define LOG_ERROR_COMPACT_TO(index)                                            \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::ERROR)                                \
   LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::ERROR)          \
   hlp::Logger(hlp::Logger::LogLevel::ERROR).setIndex(index).stream()
 #define LOG_ERROR_TO(index)                                                    \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::ERROR)                                \
   LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::ERROR)          \
   hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::ERROR)                \
           .setIndex(index)                                                     \
           .stream()
 #define LOG_ERROR_IF(cond)                                                     \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::ERROR)                                \
   LOGGER_IF_((hlp::Logger::logLevel() <= hlp::Logger::LogLevel::ERROR) &&      \
              (cond))                                                           \
   hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::ERROR, __func__)      \
           .stream()
 
 #define LOG_FATAL_COMPACT                                                      \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::FATAL)                                \
   LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::FATAL)          \
   hlp::Logger(hlp::Logger::LogLevel::FATAL).stream()
 #define LOG_FATAL                                                              \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::FATAL)                                \
   LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::FATAL)          \
   hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::FATAL).stream()
 #define LOG_FATAL_COMPACT_TO(index)                                            \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::FATAL)                                \
   LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::FATAL)          \
   hlp::Logger(hlp::Logger::LogLevel::FATAL).setIndex(index).stream()
 #define LOG_FATAL_TO(index)                                                    \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::FATAL)                                \
   LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::FATAL)          \
   hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::FATAL)                \
           .setIndex(index)                                                     \
           .stream()
 #define LOG_FATAL_IF(cond)                                                     \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::FATAL)                                \
   LOGGER_IF_((hlp::Logger::logLevel() <= hlp::Logger::LogLevel::FATAL) &&      \
              (cond))                                                           \
   hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::FATAL).stream()
@@ -349,6 +393,64 @@ class Logger : public NonCopyable {
 #define LOG_RAW hlp::RawLogger().stream()
 #define LOG_RAW_TO(index) hlp::RawLogger().setIndex(index).stream()
 
+// LOG_INFO_FMT("order {} filled at {}", id, px): the format string is
+// checked against the arguments at compile time and expanded into appends
+#ifdef NLOG
+#define LOG_TRACE_FMT(format, ...)                                             \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::TRACE)                                \
+  LOGGER_IF_(0)                                                                \
+  hlp::detail::formatTo(                                                       \
+          hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::TRACE,        \
+                      __func__)                                                \
+                  .stream(),                                                   \
+          HLP_FMT_STRING_(format), ##__VA_ARGS__)
+#else
+#define LOG_TRACE_FMT(format, ...)                                             \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::TRACE)                                \
+  LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::TRACE)          \
+  hlp::detail::formatTo(                                                       \
+          hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::TRACE,        \
+                      __func__)                                                \
+                  .stream(),                                                   \
+          HLP_FMT_STRING_(format), ##__VA_ARGS__)
+#endif
+#define LOG_DEBUG_FMT(format, ...)                                             \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::DEBUG)                                \
+  LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::DEBUG)          \
+  hlp::detail::formatTo(                                                       \
+          hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::DEBUG,        \
+                      __func__)                                                \
+                  .stream(),                                                   \
+          HLP_FMT_STRING_(format), ##__VA_ARGS__)
+#define LOG_INFO_FMT(format, ...)                                              \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::INFO)                                 \
+  LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::INFO)           \
+  hlp::detail::formatTo(                                                       \
+          hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::INFO)         \
+                  .stream(),                                                   \
+          HLP_FMT_STRING_(format), ##__VA_ARGS__)
+#define LOG_WARN_FMT(format, ...)                                              \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::WARN)                                 \
+  LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::WARN)           \
+  hlp::detail::formatTo(                                                       \
+          hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::WARN)         \
+                  .stream(),                                                   \
+          HLP_FMT_STRING_(format), ##__VA_ARGS__)
+#define LOG_ERROR_FMT(format, ...)                                             \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::ERROR)                                \
+  LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::ERROR)          \
+  hlp::detail::formatTo(                                                       \
+          hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::ERROR)        \
+                  .stream(),                                                   \
+          HLP_FMT_STRING_(format), ##__VA_ARGS__)
+#define LOG_FATAL_FMT(format, ...)                                             \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::FATAL)                                \
+  LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::FATAL)          \
+  hlp::detail::formatTo(                                                       \
+          hlp::Logger(__FILE__, __LINE__, hlp::Logger::LogLevel::FATAL)        \
+                  .stream(),                                                   \
+          HLP_FMT_STRING_(format), ##__VA_ARGS__)
+
 const char* strerror_tl(int savedErrno);
 
 }  // namespace hlp
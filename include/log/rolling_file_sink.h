@@ -0,0 +1,274 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <string>
+#include <dirent.h>
+#include "hlp/date.h"
+#include "log_compression.h"
+#include "log_file_sink.h"
+
+namespace hlp {
+
+// Size/day rotating wrapper around another LogFileSink, following
+// AsyncFileLogger's naming: records go to <path><basename><ext> and a full
+// file is renamed to <basename>.<yymmdd-hhmmss>.<seq><ext>. The next file is
+// created, opened and preallocated on a background task while the current
+// one fills, so a rotation costs the writer two renames. Wrap the sinks in
+// CompressedFileSink to compress while writing, or set an ArchiveCompressor
+// to compress rotated files in the background.
+class RollingFileSink : public LogFileSink {
+ public:
+  using SinkFactory = std::function<LogFileSinkPtr()>;
+
+  explicit RollingFileSink(SinkFactory factory = defaultFactory())
+          : factory_(std::move(factory)) {
+  }
+  ~RollingFileSink() override {
+    close();
+  }
+
+  void setFileSizeLimit(uint64_t size_limit) {
+    size_limit_ = size_limit;
+  }
+  void setMaxFiles(size_t max_files) {
+    max_files_ = max_files;
+  }
+  void setSwitchOnLimitOnly(bool flag = true) {
+    switchOnLimitOnly_ = flag;
+  }
+  // Preopen the next file in the background (default on)
+  void setPreOpen(bool flag = true) {
+    pre_open_ = flag;
+  }
+  // Rotated files are handed to compressor and kept as <name><extension>
+  void setArchiveCompressor(std::shared_ptr<ArchiveCompressor> compressor) {
+    archive_compressor_ = std::move(compressor);
+  }
+  void setFilename(const std::string& basename,
+                   const std::string& extname = ".log",
+                   const std::string& filepath = "./") {
+    file_basename_ = basename;
+    file_extname_ = (extname[0] == '.') ? extname : "." + extname;
+    file_path_ = filepath;
+    if (file_path_.empty())
+      file_path_ = "./";
+    if (file_path_[file_path_.length() - 1] != '/')
+      file_path_ += "/";
+  }
+
+  // An empty fullname uses the setFilename() names, otherwise fullname is
+  // split into path, basename and extension
+  bool open(const std::string& fullname) override {
+    close();
+    if (!fullname.empty()) {
+      auto slash{ fullname.rfind('/') };
+      std::string name{ slash == std::string::npos ? fullname
+                                                   : fullname.substr(slash + 1) };
+      std::string path{ slash == std::string::npos
+                                ? "./"
+                                : fullname.substr(0, slash + 1) };
+      auto dot{ name.rfind('.') };
+      if (dot == std::string::npos || dot == 0) {
+        setFilename(name, ".log", path);
+      } else {
+        setFilename(name.substr(0, dot), name.substr(dot), path);
+      }
+    }
+    fullname_ = file_path_ + file_basename_ + file_extname_;
+    next_name_ = file_path_ + "." + file_basename_ + ".next" + file_extname_;
+    initFilenameQueue();
+    // Left behind by a process that did not close() cleanly
+    ::unlink(next_name_.c_str());
+    current_ = openSink(fullname_);
+    creation_date_ = Date::now();
+    preOpen();
+    return current_ != nullptr;
+  }
+
+  void close() override {
+    if (next_.valid()) {
+      if (auto next{ next_.get() }) {
+        next->close();
+        ::unlink(next_name_.c_str());
+      }
+    }
+    if (current_) {
+      current_->close();
+      errors_ += current_->errors();
+      current_.reset();
+    }
+  }
+
+  void write(const struct iovec* iov, int count) override {
+    if (!current_)
+      return;
+    if (!switchOnLimitOnly_ && current_->length() > 0 &&
+        Date::now().roundDay() != creation_date_.roundDay()) {
+      switchLog();
+    }
+    current_->write(iov, count);
+    if (current_ && current_->length() > size_limit_) {
+      switchLog();
+    }
+  }
+
+  void flush() override {
+    if (current_)
+      current_->flush();
+  }
+
+  uint64_t length() const override {
+    return current_ ? current_->length() : 0;
+  }
+
+  int fd() const override {
+    return current_ ? current_->fd() : -1;
+  }
+
+  size_t rotations() const override {
+    return rotations_;
+  }
+
+  uint64_t errors() const override {
+    return errors_ + (current_ ? current_->errors() : 0);
+  }
+
+ protected:
+  static SinkFactory defaultFactory() {
+    return []() -> LogFileSinkPtr {
+      return std::make_shared<PwritevFileSink>();
+    };
+  }
+
+  LogFileSinkPtr openSink(const std::string& name) {
+    auto sink{ factory_() };
+    if (!sink || !sink->open(name))
+      return nullptr;
+    sink->preallocate(size_limit_);
+    return sink;
+  }
+
+  void preOpen() {
+    if (!pre_open_)
+      return;
+    next_ = std::async(std::launch::async,
+                       [this, name = next_name_]() { return openSink(name); });
+  }
+
+  // The current file is renamed while still open, so a failed rename
+  // leaves it in place and in use; the pre-opened file is only moved over
+  // fullname_ once the current one is archived
+  void switchLog() {
+    char seq[32];
+    snprintf(seq, sizeof(seq), ".%06llu",
+             static_cast<unsigned long long>(file_seq_++ % 1000000));
+    std::string archive{
+      file_path_ + file_basename_ + "." +
+      creation_date_.toCustomFormattedString("%y%m%d-%H%M%S") + seq +
+      file_extname_
+    };
+    if (::rename(fullname_.c_str(), archive.c_str()) != 0) {
+      if (!switch_failed_) {
+        std::cerr << "Can't archive " << fullname_ << " as " << archive
+                  << ": " << strerror(errno) << "\n";
+      }
+      switch_failed_ = true;
+      --file_seq_;
+      return;
+    }
+    switch_failed_ = false;
+    current_->close();
+    errors_ += current_->errors();
+    if (archive_compressor_)
+      archive_compressor_->submit(archive);
+    if (max_files_ > 0) {
+      filename_queue_.push_back(archive);
+      deleteOldFile();
+    }
+
+    LogFileSinkPtr next{ next_.valid() ? next_.get() : nullptr };
+    if (next && ::rename(next_name_.c_str(), fullname_.c_str()) != 0) {
+      next->close();
+      next.reset();
+    }
+    current_ = next ? std::move(next) : openSink(fullname_);
+    creation_date_ = Date::now();
+    ++rotations_;
+    preOpen();
+  }
+
+  void initFilenameQueue() {
+    filename_queue_.clear();
+    if (max_files_ == 0)
+      return;
+    DIR* dir{ ::opendir(file_path_.c_str()) };
+    if (!dir)
+      return;
+    std::string prefix{ file_basename_ + "." };
+    std::string compressed_ext{ compressedExtension() };
+    auto ends_with{ [](const std::string& name, const std::string& suffix) {
+      return name.size() >= suffix.size() &&
+             name.compare(name.size() - suffix.size(), suffix.size(),
+                          suffix) == 0;
+    } };
+    while (struct dirent* entry = ::readdir(dir)) {
+      std::string name{ entry->d_name };
+      // Compressed archives are queued under their uncompressed name
+      if (!compressed_ext.empty() && ends_with(name, compressed_ext))
+        name.resize(name.size() - compressed_ext.size());
+      if (name.size() > prefix.size() + file_extname_.size() &&
+          name.compare(0, prefix.size(), prefix) == 0 &&
+          ends_with(name, file_extname_)) {
+        filename_queue_.push_back(file_path_ + name);
+      }
+    }
+    ::closedir(dir);
+    std::sort(filename_queue_.begin(), filename_queue_.end());
+    filename_queue_.erase(
+            std::unique(filename_queue_.begin(), filename_queue_.end()),
+            filename_queue_.end());
+    deleteOldFile();
+  }
+
+  void deleteOldFile() {
+    std::string compressed_ext{ compressedExtension() };
+    while (filename_queue_.size() > max_files_) {
+      ::unlink(filename_queue_.front().c_str());
+      if (!compressed_ext.empty())
+        ::unlink((filename_queue_.front() + compressed_ext).c_str());
+      filename_queue_.pop_front();
+    }
+  }
+
+  std::string compressedExtension() const {
+    return archive_compressor_ ? archive_compressor_->extension() : "";
+  }
+
+  SinkFactory factory_;
+  std::shared_ptr<ArchiveCompressor> archive_compressor_;
+  LogFileSinkPtr current_;
+  std::future<LogFileSinkPtr> next_;
+  Date creation_date_;
+  std::string file_path_{ "./" };
+  std::string file_basename_{ "help" };
+  std::string file_extname_{ ".log" };
+  std::string fullname_;
+  std::string next_name_;
+  uint64_t size_limit_{ 20 * 1024 * 1024 };
+  bool switchOnLimitOnly_{ false };
+  bool pre_open_{ true };
+  size_t max_files_{ 0 };
+  uint64_t file_seq_{ 0 };
+  size_t rotations_{ 0 };
+  bool switch_failed_{ false };
+  std::deque<std::string> filename_queue_;
+};
+
+}  // namespace hlp
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "hlp/number_format.h"
+#include "log_stager.h"
+#include "logger.h"
+#include "rolling_file_sink.h"
+
+namespace hlp {
+
+// N independent writer pipelines, each a LogStager with its own harvester
+// thread in front of its own RollingFileSink, so files on a fast device are
+// written in parallel. Shard i writes <basename>.<i><ext> and rotates on
+// its own. A producer thread always lands on the same shard, which keeps
+// its records in order within that file. With sequencing on, every record
+// is prefixed with a 16-digit hex sequence number taken from one global
+// counter, and mergeLogFiles() (log/log_merge.h, tools/hlp_log_merge.cc)
+// restores the total order. The counter starts at the start() time in
+// milliseconds shifted left by 20 bits, so a restarted run appending to the
+// same files numbers its records above the previous run's, unless that run
+// averaged more than 2^20 records a millisecond.
+//
+//   hlp::ShardedFileLogger logger(4);
+//   logger.setFilename("audit", ".log", "/data/logs");
+//   logger.setSequenced();
+//   logger.start();
+//   logger.install();
+class ShardedFileLogger : public NonCopyable {
+ public:
+  static constexpr size_t kSequenceSize{ 17 };
+  static constexpr int kSequenceRunShift{ 20 };
+
+  explicit ShardedFileLogger(size_t shard_count = 4,
+                             RollingFileSink::SinkFactory factory = {}) {
+    shard_count = std::max<size_t>(shard_count, 1);
+    for (size_t i = 0; i < shard_count; ++i) {
+      auto sink{ factory ? std::make_shared<RollingFileSink>(factory)
+                         : std::make_shared<RollingFileSink>() };
+      shards_.emplace_back(std::make_unique<Shard>(std::move(sink)));
+    }
+    setFilename("help");
+  }
+  ~ShardedFileLogger() {
+    stop();
+  }
+
+  // Settings below apply to every shard and must be made before start()
+  void setFilename(const std::string& basename,
+                   const std::string& extname = ".log",
+                   const std::string& filepath = "./") {
+    for (size_t i = 0; i < shards_.size(); ++i) {
+      shards_[i]->sink_->setFilename(basename + "." + std::to_string(i),
+                                     extname, filepath);
+    }
+  }
+  void setFileSizeLimit(uint64_t size_limit) {
+    for (auto& shard : shards_) {
+      shard->sink_->setFileSizeLimit(size_limit);
+    }
+  }
+  void setMaxFiles(size_t max_files) {
+    for (auto& shard : shards_) {
+      shard->sink_->setMaxFiles(max_files);
+    }
+  }
+  void setSequenced(bool flag = true) {
+    sequenced_ = flag;
+  }
+
+  size_t shardCount() const {
+    return shards_.size();
+  }
+  // For per-shard stager settings (before start()) and telemetry
+  LogStager& stager(size_t shard) {
+    return shards_[shard]->stager_;
+  }
+  RollingFileSink& sink(size_t shard) {
+    return *shards_[shard]->sink_;
+  }
+
+  bool start() {
+    uint64_t millis{
+      static_cast<uint64_t>(Date::now().microSecondsSinceEpoch()) / 1000
+    };
+    sequence_.store(millis << kSequenceRunShift, std::memory_order_relaxed);
+    bool ok{ true };
+    for (auto& shard : shards_) {
+      ok = shard->sink_->open("") && ok;
+      shard->stager_.start();
+    }
+    return ok;
+  }
+
+  void stop() {
+    for (auto& shard : shards_) {
+      shard->stager_.stop();
+      shard->sink_->close();
+    }
+  }
+
+  // Shard of the calling thread; threads are spread round-robin
+  size_t threadShard() const {
+    static std::atomic<size_t> next_thread{ 0 };
+    thread_local size_t thread_index{ next_thread.fetch_add(
+            1, std::memory_order_relaxed) };
+    return thread_index % shards_.size();
+  }
+
+  void output(const char* msg, const uint64_t len) {
+    outputTo(threadShard(), msg, len);
+  }
+
+  void outputTo(size_t shard, const char* msg, const uint64_t len) {
+    LogStager& stager{ shards_[shard % shards_.size()]->stager_ };
+    if (!sequenced_) {
+      stager.output(msg, len);
+      return;
+    }
+    int level{ LogStager::recordLevel(msg, len) };
+    char* buf{ stager.reserve(kSequenceSize + len, level) };
+    if (buf) {
+      writeSequence(buf);
+      memcpy(buf + kSequenceSize, msg, len);
+      stager.commit(kSequenceSize + len);
+    } else {
+      std::string record(kSequenceSize + len, '\0');
+      writeSequence(&record[0]);
+      memcpy(&record[kSequenceSize], msg, len);
+      stager.output(record.data(), record.size(), level);
+    }
+  }
+
+  void flush() {
+    for (auto& shard : shards_) {
+      shard->stager_.flush();
+    }
+  }
+
+  // Routes Logger output through the shards: everything by producer thread,
+  // or one Logger index to one shard (index % shardCount())
+  void install(int index = -1) {
+    if (index < 0) {
+      Logger::setOutputFunction(
+              [this](const char* msg, const uint64_t len) { output(msg, len); },
+              [this]() { flush(); });
+    } else {
+      auto shard{ static_cast<size_t>(index) };
+      Logger::setOutputFunction(
+              [this, shard](const char* msg, const uint64_t len) {
+                outputTo(shard, msg, len);
+              },
+              [this, shard]() {
+                shards_[shard % shards_.size()]->stager_.flush();
+              },
+              index);
+    }
+  }
+
+  uint64_t lostCount() const {
+    uint64_t lost{ 0 };
+    for (auto& shard : shards_) {
+      lost += shard->stager_.lostCount();
+    }
+    return lost;
+  }
+
+ private:
+  struct Shard {
+    explicit Shard(std::shared_ptr<RollingFileSink> sink)
+            : sink_(std::move(sink)), stager_(sink_) {
+    }
+
+    std::shared_ptr<RollingFileSink> sink_;
+    LogStager stager_;
+  };
+
+  // "%016llX " of the next sequence number
+  void writeSequence(char* buf) {
+    uint64_t seq{ sequence_.fetch_add(1, std::memory_order_relaxed) };
+    for (int i = 15; i >= 0; --i) {
+      buf[i] = internal::kHexDigits[seq & 0xf];
+      seq >>= 4;
+    }
+    buf[16] = ' ';
+  }
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+  bool sequenced_{ false };
+  std::atomic<uint64_t> sequence_{ 0 };
+};
+
+}  // namespace hlp
@@ -0,0 +1,275 @@
+#pragma once
+
+#include <cassert>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <thread>
+#endif
+#include "log_stager.h"
+#include "logger.h"
+
+namespace hlp {
+
+// Logger counterpart that formats a record straight into a LogStager's
+// staging buffer, so every byte is written to memory once instead of going
+// LogStream -> output function -> sink buffer. Records use Logger's layout:
+//   <yyyymmdd hh:mm:ss.uuuuuu> [UTC] <tid> <LEVEL> <message> - <file>:<line>
+// A record longer than the in-place reservation spills to a heap string.
+class StagedLogger : public NonCopyable {
+ public:
+  StagedLogger(LogStager& stager, Logger::SourceFile file, int line,
+               Logger::LogLevel level)
+          : stager_(stager),
+            source_file_(file),
+            file_line_(line),
+            log_level_(level) {
+    begin_ = stager_.reserve(kReserveSize, level);
+    if (begin_) {
+      cur_ = begin_;
+      end_ = begin_ + kReserveSize;
+    } else {
+      spilled_ = true;
+    }
+    formatTime();
+    append(threadIdString());
+    append(kLevelStrings[level]);
+  }
+
+  ~StagedLogger() {
+    append(" - ", 3);
+    append(source_file_.data_, source_file_.size_);
+    *this << ':' << file_line_ << '\n';
+    if (!spilled_) {
+      stager_.commit(static_cast<size_t>(cur_ - begin_));
+    } else {
+      if (begin_)
+        stager_.commit(0);
+      stager_.output(spill_.data(), spill_.length(), log_level_);
+    }
+    if (log_level_ == Logger::LogLevel::FATAL) {
+      stager_.flush();
+    }
+  }
+
+  StagedLogger& stream() {
+    return *this;
+  }
+
+  void append(const char* data, size_t len) {
+    char* dst{ room(len) };
+    memcpy(dst, data, len);
+    finish(dst, len);
+  }
+
+  void append(std::string_view str) {
+    append(str.data(), str.size());
+  }
+
+  StagedLogger& operator<<(bool v) {
+    append(v ? "1" : "0", 1);
+    return *this;
+  }
+
+  StagedLogger& operator<<(char v) {
+    append(&v, 1);
+    return *this;
+  }
+
+  StagedLogger& operator<<(const char* str) {
+    if (str) {
+      append(str, strlen(str));
+    } else {
+      append("(null)", 6);
+    }
+    return *this;
+  }
+
+  StagedLogger& operator<<(std::string_view str) {
+    append(str.data(), str.size());
+    return *this;
+  }
+
+  StagedLogger& operator<<(const std::string& str) {
+    append(str.data(), str.size());
+    return *this;
+  }
+
+  StagedLogger& operator<<(const Fmt& v) {
+    append(v.data(), v.length());
+    return *this;
+  }
+
+  StagedLogger& operator<<(const void* p) {
+    constexpr size_t kMaxNumericSize =
+            std::numeric_limits<uintptr_t>::digits / 4 + 4;
+    char* buf{ room(kMaxNumericSize) };
+    buf[0] = '0';
+    buf[1] = 'x';
+    size_t len{ detail::convertHex(buf + 2, reinterpret_cast<uintptr_t>(p)) };
+    finish(buf, len + 2);
+    return *this;
+  }
+
+  template <typename T,
+            typename = std::enable_if_t<std::is_arithmetic_v<T> &&
+                                        !std::is_same_v<T, bool> &&
+                                        !std::is_same_v<T, char>>>
+  StagedLogger& operator<<(T v) {
+    if constexpr (std::is_integral_v<T>) {
+      constexpr size_t kMaxNumericSize{ std::numeric_limits<T>::digits10 + 4 };
+      char* buf{ room(kMaxNumericSize) };
+      finish(buf, detail::convert(buf, v));
+    } else if constexpr (!std::is_same_v<T, long double>) {
+      char* buf{ room(internal::kMaxFloatSize) };
+      finish(buf, internal::formatFloat(buf, v));
+    } else {
+      constexpr size_t kMaxNumericSize{ 48 };
+      char* buf{ room(kMaxNumericSize) };
+      int len{ snprintf(buf, kMaxNumericSize, "%.12Lg", v) };
+      finish(buf, static_cast<size_t>(len));
+    }
+    return *this;
+  }
+
+ protected:
+  static constexpr size_t kReserveSize{ 1024 };
+  static constexpr std::string_view kLevelStrings[]{
+    "TRACE ", "DEBUG ", "INFO  ", "WARN  ", "ERROR ", "FATAL "
+  };
+
+  // Space for n more bytes, in place while the reservation lasts
+  char* room(size_t n) {
+    if (!spilled_) {
+      if (static_cast<size_t>(end_ - cur_) >= n)
+        return cur_;
+      spill_.assign(begin_, cur_);
+      spilled_ = true;
+    }
+    size_t old_len{ spill_.length() };
+    spill_.resize(old_len + n);
+    return &spill_[old_len];
+  }
+
+  // Keeps len of the bytes handed out by room()
+  void finish(char* pos, size_t len) {
+    if (!spilled_) {
+      cur_ = pos + len;
+    } else {
+      spill_.resize(static_cast<size_t>(pos - spill_.data()) + len);
+    }
+  }
+
+  static const std::string& threadIdString() {
+    thread_local std::string tid = []() {
+#if defined(__linux__)
+      return std::to_string(static_cast<long>(::syscall(SYS_gettid))) + " ";
+#else
+      return std::to_string(
+                     std::hash<std::thread::id>()(std::this_thread::get_id())) +
+             " ";
+#endif
+    }();
+    return tid;
+  }
+
+  static void twoDigits(char* buf, int value) {
+    buf[0] = static_cast<char>('0' + value / 10);
+    buf[1] = static_cast<char>('0' + value % 10);
+  }
+
+  // "yyyymmdd hh:mm:ss." of the last second this thread logged in; only
+  // the microseconds are rendered per record
+  struct TimeCache {
+    int64_t seconds_{ -1 };
+    bool local_{ false };
+    char prefix_[18];
+  };
+
+  static void renderSecond(TimeCache& cache, int64_t seconds, bool local) {
+    int64_t shown{ seconds };
+    if (local)
+      shown += TimeZone::local().offsetAt(seconds);
+    char buf[Date::kMaxFormattedSize];
+    Date(shown * MICRO_SECONDS_PRE_SEC).formatTimestamp(buf, false);
+    memcpy(cache.prefix_, buf, 17);
+    cache.prefix_[17] = '.';
+    cache.seconds_ = seconds;
+    cache.local_ = local;
+  }
+
+  void formatTime() {
+    thread_local TimeCache cache;
+    int64_t micro_seconds{ Date::now().microSecondsSinceEpoch() };
+    int64_t seconds{ micro_seconds / MICRO_SECONDS_PRE_SEC };
+    bool local{ Logger::displayLocalTime() };
+    if (seconds != cache.seconds_ || local != cache.local_) {
+      renderSecond(cache, seconds, local);
+    }
+
+    constexpr size_t kTimeSize{ 30 };
+    char* buf{ room(kTimeSize) };
+    memcpy(buf, cache.prefix_, sizeof(cache.prefix_));
+    auto us{ static_cast<int>(micro_seconds % MICRO_SECONDS_PRE_SEC) };
+    twoDigits(buf + 18, us / 10000);
+    twoDigits(buf + 20, us / 100 % 100);
+    twoDigits(buf + 22, us % 100);
+    if (local) {
+      buf[24] = ' ';
+      finish(buf, 25);
+    } else {
+      memcpy(buf + 24, " UTC ", 5);
+      finish(buf, 29);
+    }
+  }
+
+  LogStager& stager_;
+  Logger::SourceFile source_file_;
+  int file_line_;
+  Logger::LogLevel log_level_;
+  char* begin_{ nullptr };
+  char* cur_{ nullptr };
+  char* end_{ nullptr };
+  bool spilled_{ false };
+  std::string spill_;
+};
+
+}  // namespace hlp
+
+#define LOG_TRACE_STAGED(stager)                                               \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::TRACE)                                \
+  LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::TRACE)          \
+  hlp::StagedLogger(stager, __FILE__, __LINE__, hlp::Logger::LogLevel::TRACE)  \
+          .stream()
+#define LOG_DEBUG_STAGED(stager)                                               \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::DEBUG)                                \
+  LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::DEBUG)          \
+  hlp::StagedLogger(stager, __FILE__, __LINE__, hlp::Logger::LogLevel::DEBUG)  \
+          .stream()
+#define LOG_INFO_STAGED(stager)                                                \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::INFO)                                 \
+  LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::INFO)           \
+  hlp::StagedLogger(stager, __FILE__, __LINE__, hlp::Logger::LogLevel::INFO)   \
+          .stream()
+#define LOG_WARN_STAGED(stager)                                                \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::WARN)                                 \
+  LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::WARN)           \
+  hlp::StagedLogger(stager, __FILE__, __LINE__, hlp::Logger::LogLevel::WARN)   \
+          .stream()
+#define LOG_ERROR_STAGED(stager)                                               \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::ERROR)                                \
+  LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::ERROR)          \
+  hlp::StagedLogger(stager, __FILE__, __LINE__, hlp::Logger::LogLevel::ERROR)  \
+          .stream()
+#define LOG_FATAL_STAGED(stager)                                               \
+  HLP_LOG_ACTIVE_(hlp::Logger::LogLevel::FATAL)                                \
+  LOGGER_IF_(hlp::Logger::logLevel() <= hlp::Logger::LogLevel::FATAL)          \
+  hlp::StagedLogger(stager, __FILE__, __LINE__, hlp::Logger::LogLevel::FATAL)  \
+          .stream()
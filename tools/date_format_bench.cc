@@ -0,0 +1,78 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include "hlp/date.h"
+
+// Compares Date's fixed-layout parsers and printers with the
+// strftime/strptime based fromDbString/toDbString/toFormattedString
+namespace {
+template <typename T, typename Fn>
+double nanosPerCall(const std::vector<T>& values, Fn&& fn) {
+  constexpr int kRounds{ 5 };
+  size_t sink{ 0 };
+  auto start{ std::chrono::steady_clock::now() };
+  for (int r = 0; r < kRounds; ++r) {
+    for (const T& v : values) {
+      sink += fn(v);
+    }
+  }
+  auto elapsed{ std::chrono::steady_clock::now() - start };
+  if (sink == 0)
+    std::puts("");
+  return std::chrono::duration<double, std::nano>(elapsed).count() /
+         (static_cast<double>(values.size()) * kRounds);
+}
+}  // namespace
+
+int main() {
+  std::mt19937_64 rng(42);
+  std::vector<hlp::Date> dates(1 << 18);
+  for (auto& date : dates) {
+    // 2000-01-01 .. 2100-01-01
+    date = hlp::Date(946684800000000LL +
+                     static_cast<int64_t>(rng() % 3155760000000000ULL));
+  }
+  std::vector<std::string> texts;
+  texts.reserve(dates.size());
+  for (const auto& date : dates) {
+    texts.push_back(date.toDbString());
+  }
+
+  char buf[hlp::Date::kMaxFormattedSize];
+  std::printf("%-22s %10s %10s\n", "operation", "legacy ns", "current ns");
+  std::printf(
+          "%-22s %10.2f %10.2f\n", "parse db string",
+          nanosPerCall(texts,
+                       [](const std::string& text) {
+                         return static_cast<size_t>(
+                                 hlp::Date::fromDbString(text)
+                                         .microSecondsSinceEpoch());
+                       }),
+          nanosPerCall(texts, [](const std::string& text) {
+            hlp::Date date;
+            hlp::Date::parseDbString(text, date);
+            return static_cast<size_t>(date.microSecondsSinceEpoch());
+          }));
+  std::printf(
+          "%-22s %10.2f %10.2f\n", "format db string",
+          nanosPerCall(dates,
+                       [](const hlp::Date& date) {
+                         return date.toDbString().size();
+                       }),
+          nanosPerCall(dates, [&buf](const hlp::Date& date) {
+            return date.formatDbString(buf);
+          }));
+  std::printf(
+          "%-22s %10.2f %10.2f\n", "format timestamp",
+          nanosPerCall(dates,
+                       [](const hlp::Date& date) {
+                         return date.toFormattedString(true).size();
+                       }),
+          nanosPerCall(dates, [&buf](const hlp::Date& date) {
+            return date.formatTimestamp(buf, true);
+          }));
+  return 0;
+}
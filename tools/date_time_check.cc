@@ -0,0 +1,315 @@
+#include <algorithm>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "hlp/date.h"
+
+// Checks Date's calendar arithmetic, parser and TimeZone against libc:
+// civil-day round trips, leap-second and offset parsing, and the offsets
+// of POSIX TZ rules and installed TZif zones against localtime_r.
+//   hlp-date-time-check [zone...]   (default: every zone under TZDIR)
+namespace {
+constexpr int kMaxReports{ 20 };
+int failures{ 0 };
+
+void fail(const char* format, ...) {
+  if (++failures > kMaxReports)
+    return;
+  va_list args;
+  va_start(args, format);
+  std::fputs("FAIL ", stdout);
+  std::vprintf(format, args);
+  std::fputc('\n', stdout);
+  va_end(args);
+}
+
+void report(const char* what, int failures_before, const std::string& detail) {
+  std::printf("%-14s %s (%s)\n", what,
+              failures == failures_before ? "ok" : "FAILED", detail.c_str());
+}
+
+int64_t utcSeconds(int year, int month, int day, int hour = 0, int minute = 0,
+                   int second = 0) {
+  struct tm tm {};
+  tm.tm_year = year - 1900;
+  tm.tm_mon = month - 1;
+  tm.tm_mday = day;
+  tm.tm_hour = hour;
+  tm.tm_min = minute;
+  tm.tm_sec = second;
+  return static_cast<int64_t>(timegm(&tm));
+}
+
+void checkCivilDays() {
+  using namespace hlp::internal;
+  int before{ failures };
+  constexpr int64_t kFirstYear{ -1000 };
+  constexpr int64_t kLastYear{ 9999 };
+  int64_t days{ daysFromCivil(kFirstYear, 1, 1) };
+  int64_t count{ 0 };
+  for (int64_t year = kFirstYear; year <= kLastYear; ++year) {
+    for (unsigned month = 1; month <= 12; ++month) {
+      for (unsigned day = 1; day <= daysInMonth(year, month); ++day) {
+        if (daysFromCivil(year, month, day) != days) {
+          fail("daysFromCivil(%lld-%02u-%02u) != %lld",
+               static_cast<long long>(year), month, day,
+               static_cast<long long>(days));
+        }
+        CivilTime civil{ civilFromDays(days) };
+        if (civil.year_ != year || civil.month_ != month ||
+            civil.day_ != day) {
+          fail("civilFromDays(%lld) is %lld-%02u-%02u, not %lld-%02u-%02u",
+               static_cast<long long>(days),
+               static_cast<long long>(civil.year_), civil.month_,
+               civil.day_, static_cast<long long>(year), month, day);
+        }
+        if (year >= 1900 && year < 2200 &&
+            days * 86400 != utcSeconds(static_cast<int>(year),
+                                       static_cast<int>(month),
+                                       static_cast<int>(day))) {
+          fail("daysFromCivil(%lld-%02u-%02u) disagrees with timegm",
+               static_cast<long long>(year), month, day);
+        }
+        ++days;
+        ++count;
+      }
+    }
+  }
+  // Negative times round toward the earlier day
+  CivilTime civil{ civilFromMicroSeconds(-1) };
+  if (civil.year_ != 1969 || civil.month_ != 12 || civil.day_ != 31 ||
+      civil.hour_ != 23 || civil.minute_ != 59 || civil.second_ != 59 ||
+      civil.micro_second_ != 999999) {
+    fail("civilFromMicroSeconds(-1) is not 1969-12-31 23:59:59.999999");
+  }
+  report("civil days", before, std::to_string(count) + " days");
+}
+
+void checkParsing() {
+  struct Case {
+    const char* text_;
+    bool ok_;
+    int64_t micro_seconds_;
+    bool has_offset_;
+  };
+  constexpr int64_t kHour{ 3600LL * 1000000 };
+  const int64_t base{ utcSeconds(2024, 1, 2, 3, 4, 5) * 1000000 };
+  const Case cases[]{
+    { "2024-01-02", true, utcSeconds(2024, 1, 2) * 1000000, false },
+    { "2024-01-02 03:04", true, base - 5 * 1000000, false },
+    { "2024-01-02T03:04:05", true, base, false },
+    { "2024-01-02 03:04:05.25", true, base + 250000, false },
+    { "2024-01-02 03:04:05.1234567", true, base + 123456, false },
+    { "1969-12-31 23:59:59.5", true, -500000, false },
+    { "2016-12-31 23:59:60", true, utcSeconds(2017, 1, 1) * 1000000, false },
+    { "2016-12-31T23:59:60.5Z", true,
+      utcSeconds(2017, 1, 1) * 1000000 + 500000, true },
+    { "2024-01-02 03:04:05Z", true, base, true },
+    { "2024-01-02 03:04:05+05", true, base - 5 * kHour, true },
+    { "2024-01-02 03:04:05+0530", true, base - 11 * kHour / 2, true },
+    { "2024-01-02 03:04:05+05:30", true, base - 11 * kHour / 2, true },
+    { "2024-01-02 03:04:05-03:30", true, base + 7 * kHour / 2, true },
+    { "2024-01-02 03:04:05+05:", false, 0, false },
+    { "2024-01-02 03:04:05+05:3", false, 0, false },
+    { "2024-01-02 03:04:05+053", false, 0, false },
+    { "2024-01-02 03:04:05+5", false, 0, false },
+    { "2024-01-02 03:04:05+24", false, 0, false },
+    { "2024-01-02 03:04:05+05:60", false, 0, false },
+    { "2024-01-02 03:04:05+05:30:00", false, 0, false },
+    { "2024-01-02 03:04:61", false, 0, false },
+    { "2024-01-02 24:00", false, 0, false },
+    { "2024-01-02 03", false, 0, false },
+    { "2024-01-02 03:04:05.", false, 0, false },
+    { "2024-01-02 ", false, 0, false },
+    { "2024-02-29", true, utcSeconds(2024, 2, 29) * 1000000, false },
+    { "2023-02-29", false, 0, false },
+    { "2024-13-01", false, 0, false },
+    { "2024-1-02", false, 0, false },
+  };
+  int before{ failures };
+  for (const Case& c : cases) {
+    int64_t micro_seconds{ 0 };
+    bool has_offset{ false };
+    bool ok{ hlp::internal::parseDateTime(c.text_, micro_seconds,
+                                          has_offset) };
+    if (ok != c.ok_) {
+      fail("parseDateTime(\"%s\") %s", c.text_,
+           ok ? "accepted" : "rejected");
+    } else if (ok && (micro_seconds != c.micro_seconds_ ||
+                      has_offset != c.has_offset_)) {
+      fail("parseDateTime(\"%s\") is %lld%s, not %lld%s", c.text_,
+           static_cast<long long>(micro_seconds), has_offset ? "+offset" : "",
+           static_cast<long long>(c.micro_seconds_),
+           c.has_offset_ ? "+offset" : "");
+    }
+  }
+
+  // Printers and parser agree on 0001-01-01 .. 9999-12-31
+  std::mt19937_64 rng(42);
+  const int64_t first{ hlp::internal::daysFromCivil(1, 1, 1) * 86400000000LL };
+  const int64_t last{ hlp::internal::daysFromCivil(10000, 1, 1) *
+                      86400000000LL };
+  constexpr int kRoundTrips{ 1000000 };
+  char buf[hlp::Date::kMaxFormattedSize];
+  const auto span{ static_cast<uint64_t>(last - first) };
+  for (int i = 0; i < kRoundTrips; ++i) {
+    hlp::Date date(first + static_cast<int64_t>(rng() % span));
+    hlp::Date parsed;
+    date.formatDbString(buf);
+    if (!hlp::Date::parseDbString(buf, parsed) || parsed != date)
+      fail("\"%s\" does not parse back", buf);
+    date.formatIso8601(buf);
+    if (!hlp::Date::parseDbString(buf, parsed) || parsed != date)
+      fail("\"%s\" does not parse back", buf);
+  }
+  report("date parsing", before,
+         std::to_string(sizeof(cases) / sizeof(cases[0])) + " cases, " +
+                 std::to_string(kRoundTrips) + " round trips");
+}
+
+long libcOffset(int64_t seconds) {
+  auto t{ static_cast<time_t>(seconds) };
+  struct tm tm;
+  localtime_r(&t, &tm);
+  return tm.tm_gmtoff;
+}
+
+// Compares TimeZone with localtime_r under TZ=spec at daily steps and at
+// both sides of every change localtime_r shows between them; returns the
+// number of changes
+int64_t checkZone(const std::string& spec, int64_t from, int64_t to) {
+  constexpr int64_t kStep{ 86400 };
+  setenv("TZ", spec.c_str(), 1);
+  tzset();
+  hlp::TimeZone zone(spec);
+  int64_t changes{ 0 };
+  auto compare{ [&](int64_t seconds, long expected) {
+    int32_t offset{ zone.offsetAt(seconds) };
+    if (offset != expected) {
+      fail("%s at %lld: offset %d, localtime_r says %ld", spec.c_str(),
+           static_cast<long long>(seconds), offset, expected);
+      return false;
+    }
+    return true;
+  } };
+  long previous{ libcOffset(from) };
+  compare(from, previous);
+  for (int64_t t = from + kStep; t <= to; t += kStep) {
+    long current{ libcOffset(t) };
+    if (current != previous) {
+      int64_t lo{ t - kStep };
+      int64_t hi{ t };
+      while (hi - lo > 1) {
+        int64_t mid{ lo + (hi - lo) / 2 };
+        (libcOffset(mid) == previous ? lo : hi) = mid;
+      }
+      if (compare(lo, previous))
+        compare(hi, libcOffset(hi));
+      ++changes;
+    }
+    compare(t, current);
+    previous = current;
+  }
+  return changes;
+}
+
+void checkRules() {
+  static const char* const kRules[]{
+    "UTC0",
+    "<+0530>-5:30",
+    "EST5EDT,M3.2.0,M11.1.0",
+    "CET-1CEST,M3.5.0,M10.5.0/3",
+    "AEST-10AEDT,M10.1.0,M4.1.0/3",
+    "NZST-12NZDT,M9.5.0,M4.1.0/3",
+    "<+1030>-10:30<+11>-11,M10.1.0,M4.1.0",
+    // Negative DST, as Europe/Dublin
+    "IST-1GMT0,M10.5.0,M3.5.0/1",
+    // Changes at negative times of day and past 24:00
+    "<-02>2<-01>,M3.5.0/-1,M10.5.0/0",
+    "<+03>-3<+04>,M3.5.0/26,M10.5.0/27",
+    "<-04>4<-03>,J60/1,J300/1",
+    "<-05>5<-04>,59/2,299/2",
+    // DST all year
+    "EST5EDT,0/0,J365/25",
+  };
+  int before{ failures };
+  int64_t changes{ 0 };
+  for (const char* rule : kRules) {
+    changes += checkZone(rule, utcSeconds(1970, 1, 1), utcSeconds(2100, 1, 1));
+  }
+  report("posix rules", before,
+         std::to_string(sizeof(kRules) / sizeof(kRules[0])) + " rules, " +
+                 std::to_string(changes) + " changes");
+}
+
+bool isTzif(const std::string& path) {
+  FILE* file{ fopen(path.c_str(), "rb") };
+  if (!file)
+    return false;
+  char magic[4];
+  bool tzif{ fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+             memcmp(magic, "TZif", 4) == 0 };
+  fclose(file);
+  return tzif;
+}
+
+// Zone names under dir, skipping the posix/ and right/ copies
+void findZones(const std::string& dir, const std::string& prefix,
+               std::vector<std::string>& zones) {
+  DIR* d{ opendir((dir + "/" + prefix).c_str()) };
+  if (!d)
+    return;
+  while (struct dirent* entry = readdir(d)) {
+    std::string name{ entry->d_name };
+    if (name[0] == '.' || (prefix.empty() && (name == "posix" ||
+                                               name == "right"))) {
+      continue;
+    }
+    std::string zone{ prefix.empty() ? name : prefix + "/" + name };
+    std::string path{ dir + "/" + zone };
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+      continue;
+    if (S_ISDIR(st.st_mode)) {
+      findZones(dir, zone, zones);
+    } else if (S_ISREG(st.st_mode) && isTzif(path)) {
+      zones.push_back(zone);
+    }
+  }
+  closedir(d);
+}
+
+void checkZones(std::vector<std::string> zones) {
+  if (zones.empty()) {
+    const char* dir{ getenv("TZDIR") };
+    findZones(dir ? dir : "/usr/share/zoneinfo", "", zones);
+    std::sort(zones.begin(), zones.end());
+  }
+  int before{ failures };
+  int64_t changes{ 0 };
+  for (const auto& zone : zones) {
+    changes += checkZone(zone, utcSeconds(1940, 1, 1), utcSeconds(2140, 1, 1));
+  }
+  report("tzif zones", before,
+         std::to_string(zones.size()) + " zones, " + std::to_string(changes) +
+                 " changes");
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  checkCivilDays();
+  checkParsing();
+  checkRules();
+  checkZones(std::vector<std::string>(argv + 1, argv + argc));
+  if (failures > kMaxReports)
+    std::printf("... %d failures in all\n", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,40 @@
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "log/flight_recorder.h"
+
+// Prints the rings FlightRecorderSink left in shared memory, oldest line
+// first
+int main(int argc, char* argv[]) {
+  bool unlink{ false };
+  int first{ 1 };
+  if (argc > 1 && strcmp(argv[1], "-u") == 0) {
+    unlink = true;
+    ++first;
+  }
+  if (first >= argc) {
+    std::cerr << "usage: " << argv[0] << " [-u] name...\n"
+              << "  -u  remove each ring once it is printed\n";
+    return 2;
+  }
+
+  int status{ 0 };
+  for (int i = first; i < argc; ++i) {
+    auto ring{ hlp::FlightRecorderSink::attach(argv[i]) };
+    if (!ring) {
+      std::cerr << "No flight recorder ring named " << argv[i] << "\n";
+      status = 1;
+      continue;
+    }
+    if (!ring->dumpTo(STDOUT_FILENO)) {
+      std::cerr << argv[i] << ": write failed: " << strerror(errno) << "\n";
+      return 1;
+    }
+    if (unlink)
+      ::shm_unlink(argv[i]);
+  }
+  return status;
+}
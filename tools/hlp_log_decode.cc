@@ -0,0 +1,41 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include "log/binary_log.h"
+
+// Renders binary log files written with the LOG_*_BIN macros as text
+int main(int argc, char* argv[]) {
+  hlp::BinaryLogDecoder decoder;
+  int first{ 1 };
+  if (argc > 1 && strcmp(argv[1], "-l") == 0) {
+    decoder.setDisplayLocalTime(true);
+    ++first;
+  }
+  if (first >= argc) {
+    std::cerr << "usage: " << argv[0] << " [-l] file...\n"
+              << "  -l  print local time instead of UTC\n";
+    return 2;
+  }
+
+  int status{ 0 };
+  for (int i = first; i < argc; ++i) {
+    std::ifstream in(argv[i], std::ios::binary);
+    if (!in) {
+      std::cerr << "Can't open " << argv[i] << "\n";
+      status = 1;
+      continue;
+    }
+    std::string data{ std::istreambuf_iterator<char>(in),
+                      std::istreambuf_iterator<char>() };
+    std::string text;
+    if (!decoder.decode(data, text)) {
+      std::cerr << argv[i] << ": truncated or corrupt binary log\n";
+      status = 1;
+    }
+    fwrite(text.data(), 1, text.size(), stdout);
+  }
+  return status;
+}
@@ -0,0 +1,36 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "log/log_merge.h"
+
+// Restores the total order of ShardedFileLogger output (sequence numbers,
+// or timestamps for unsequenced files) into one stream on stdout
+int main(int argc, char* argv[]) {
+  size_t window{ 1 << 20 };
+  int first{ 1 };
+  if (argc > 2 && strcmp(argv[1], "-w") == 0) {
+    window = std::strtoull(argv[2], nullptr, 10);
+    first += 2;
+  }
+  if (first >= argc) {
+    std::cerr << "usage: " << argv[0] << " [-w lines] file...\n"
+              << "  -w  reorder window in records (default 1048576)\n";
+    return 2;
+  }
+
+  std::vector<std::string> files(argv + first, argv + argc);
+  hlp::LogMergeStats stats;
+  if (!hlp::mergeLogFiles(files, stdout, window, &stats)) {
+    std::cerr << "Can't open one of the input files\n";
+    return 1;
+  }
+  if (stats.out_of_order_ > 0) {
+    std::cerr << stats.out_of_order_ << " of " << stats.records_
+              << " records out of order, try a larger -w\n";
+    return 1;
+  }
+  return 0;
+}
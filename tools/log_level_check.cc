@@ -0,0 +1,107 @@
+#include <cstdio>
+#include <functional>
+#include <string>
+#include "log/binary_log.h"
+#include "log/log_category.h"
+#include "log/log_rate_limit.h"
+#include "log/logger.h"
+#include "log/staged_logger.h"
+
+// Checks that levels below HLP_LOG_ACTIVE_LEVEL leave nothing behind.
+// Every TRACE, DEBUG and INFO statement below streams a Stripped, whose
+// operator<< is declared but never defined: the program only links if none
+// of them generated code. Their site and rate-limit statics are kept in
+// templates the discarded statements never instantiate, so `nm` shows
+// none of them at any optimization level. At run time, with every runtime
+// filter open, their arguments must not be evaluated and the WARN and ERROR
+// statements must all be written.
+//   built with HLP_LOG_ACTIVE_LEVEL=3
+#if HLP_LOG_ACTIVE_LEVEL != 3
+#error "hlp-log-level-check must be built with HLP_LOG_ACTIVE_LEVEL=3"
+#endif
+
+namespace hlp_check {
+struct Stripped {};
+
+// Never defined
+template <typename Stream>
+Stream& operator<<(Stream& stream, const Stripped&);
+}  // namespace hlp_check
+
+HLP_DEFINE_LOG_CATEGORY(kCheckLog, "check");
+
+namespace {
+using hlp_check::Stripped;
+
+int evaluated{ 0 };
+int touch() {
+  return ++evaluated;
+}
+
+// Returns the number of statements
+int logStripped(hlp::LogStager& stager) {
+  LOG_TRACE << Stripped{} << touch();
+  LOG_TRACE_TO(0) << Stripped{} << touch();
+  LOG_TRACE_IF(touch() > 0) << Stripped{};
+  LOG_DEBUG << Stripped{} << touch();
+  LOG_DEBUG_COMPACT << Stripped{} << touch();
+  LOG_DEBUG_TO(0) << Stripped{} << touch();
+  LOG_DEBUG_IF(touch() > 0) << Stripped{};
+  LOG_INFO << Stripped{} << touch();
+  LOG_INFO_COMPACT_TO(0) << Stripped{} << touch();
+  LOG_INFO.kv("n", touch()) << Stripped{};
+  LOG_DEBUG_FMT("{}", touch());
+  LOG_INFO_FMT("{}", touch());
+  LOG_DEBUG_STAGED(stager) << Stripped{} << touch();
+  LOG_INFO_STAGED(stager) << Stripped{} << touch();
+  LOG_DEBUG_BIN(stager, "{}", touch());
+  LOG_INFO_BIN(stager, "{}", touch());
+  LOG_DEBUG_CAT(kCheckLog) << Stripped{} << touch();
+  LOG_INFO_CAT(kCheckLog) << Stripped{} << touch();
+  LOG_DEBUG_EVERY_N(1) << Stripped{} << touch();
+  LOG_INFO_FIRST_N(touch()) << Stripped{};
+  LOG_DEBUG_EVERY_MS(touch()) << Stripped{};
+  LOG_INFO_RATE_LIMITED(touch(), 1) << Stripped{};
+  return 22;
+}
+
+// Returns the number of records
+int logKept(hlp::LogStager& stager) {
+  LOG_WARN << "warn " << touch();
+  LOG_ERROR_IF(touch() > 0) << "error";
+  LOG_WARN_FMT("warn {}", touch());
+  LOG_WARN_STAGED(stager) << "warn " << touch();
+  LOG_ERROR_CAT(kCheckLog) << "error " << touch();
+  LOG_WARN_EVERY_N(1) << "warn " << touch();
+  return 6;
+}
+}  // namespace
+
+int main() {
+  hlp::Logger::setLogLevel(hlp::Logger::LogLevel::TRACE);
+  kCheckLog.setLevel(hlp::Logger::LogLevel::TRACE);
+  int lines{ 0 };
+  auto count{ [&lines](const char* msg, const uint64_t len) {
+    for (uint64_t i = 0; i < len; ++i) {
+      lines += msg[i] == '\n';
+    }
+  } };
+  hlp::Logger::setOutputFunction(count, []() {});
+  hlp::LogStager stager(count);
+
+  int failures{ 0 };
+  int statements{ logStripped(stager) };
+  stager.flush();
+  std::printf("%-14s %s (%d statements, %d evaluated, %d lines)\n",
+              "stripped", evaluated == 0 && lines == 0 ? "ok" : "FAILED",
+              statements, evaluated, lines);
+  failures += evaluated != 0 || lines != 0;
+
+  evaluated = lines = 0;
+  int records{ logKept(stager) };
+  stager.flush();
+  std::printf("%-14s %s (%d of %d lines)\n", "kept",
+              lines == records ? "ok" : "FAILED", lines, records);
+  failures += lines != records;
+  return failures == 0 ? 0 : 1;
+}
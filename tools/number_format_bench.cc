@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "log/log_stream.h"
+
+// Compares LogStream's integer/hex formatting with the previous
+// divide-by-10-and-reverse implementation on ID-like values
+namespace {
+template <typename T>
+size_t legacyConvert(char buf[], T value) {
+  static const char digits[] = "9876543210123456789";
+  static const char* zero = digits + 9;
+  T i = value;
+  char* p = buf;
+  do {
+    *p++ = zero[static_cast<int>(i % 10)];
+    i /= 10;
+  } while (i);
+  if (value < 0) {
+    *p++ = '-';
+  }
+  *p = '\0';
+  std::reverse(buf, p);
+  return p - buf;
+}
+
+size_t legacyConvertHex(char buf[], uintptr_t value) {
+  static const char digits_hex[] = "0123456789ABCDEF";
+  uintptr_t i = value;
+  char* p = buf;
+  do {
+    *p++ = digits_hex[static_cast<int>(i % 16)];
+    i /= 16;
+  } while (i);
+  *p = '\0';
+  std::reverse(buf, p);
+  return p - buf;
+}
+
+template <typename Fn>
+double nanosPerCall(const std::vector<uint64_t>& values, Fn&& fn) {
+  constexpr int kRounds{ 20 };
+  char buf[32];
+  size_t sink{ 0 };
+  auto start{ std::chrono::steady_clock::now() };
+  for (int r = 0; r < kRounds; ++r) {
+    for (uint64_t v : values) {
+      sink += fn(buf, v);
+    }
+  }
+  auto elapsed{ std::chrono::steady_clock::now() - start };
+  if (sink == 0)
+    std::puts("");
+  return std::chrono::duration<double, std::nano>(elapsed).count() /
+         (static_cast<double>(values.size()) * kRounds);
+}
+}  // namespace
+
+int main() {
+  std::mt19937_64 rng(42);
+  std::vector<uint64_t> ids(1 << 20);
+  std::vector<uint64_t> small(1 << 20);
+  for (auto& v : ids)
+    v = 1000000000000ULL + rng() % 9000000000000000ULL;
+  for (auto& v : small)
+    v = rng() % 100000;
+
+  std::printf("%-22s %10s %10s\n", "values", "legacy ns", "current ns");
+  std::printf("%-22s %10.2f %10.2f\n", "64-bit ids",
+              nanosPerCall(ids, legacyConvert<uint64_t>),
+              nanosPerCall(ids, hlp::detail::convert<uint64_t>));
+  std::printf("%-22s %10.2f %10.2f\n", "counters < 100000",
+              nanosPerCall(small, legacyConvert<uint64_t>),
+              nanosPerCall(small, hlp::detail::convert<uint64_t>));
+  std::printf("%-22s %10.2f %10.2f\n", "hex pointers",
+              nanosPerCall(ids, legacyConvertHex),
+              nanosPerCall(ids, hlp::detail::convertHex));
+  return 0;
+}